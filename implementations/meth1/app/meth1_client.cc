@@ -2,6 +2,7 @@
 #include <sys/types.h>
 
 #include <cstdlib>
+#include <cstring>
 #include <chrono>
 #include <iostream>
 #include <sstream>
@@ -21,6 +22,15 @@ File query_file( string out_dir, unsigned int query, string type )
   return {out, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR};
 }
 
+/* Key from (up to 10 bytes of) hex, padded with zeros */
+void parse_key( string hex, uint8_t * key )
+{
+  memset( key, 0, Rec::KEY_LEN );
+  for ( size_t i = 0; i < Rec::KEY_LEN and 2 * i + 1 < hex.size(); i++ ) {
+    key[i] = stoul( hex.substr( 2 * i, 2 ), nullptr, 16 );
+  }
+}
+
 void run_cmd( Cluster & c, string out_dir, string cmd, uint64_t read_ahead )
 {
   if ( cmd == "first" ) {
@@ -45,6 +55,24 @@ void run_cmd( Cluster & c, string out_dir, string cmd, uint64_t read_ahead )
     auto dur = chrono::duration_cast<chrono::milliseconds>( end - start ).count();
     print( "\ncmd-chunk", dur );
 
+  } else if ( cmd.compare( 0, 5, "keys-" ) == 0 ) {
+    // keys-<lo>-<hi>-<limit>, keys in hex
+    size_t i = cmd.find( '-', 5 ), j = cmd.find( '-', i + 1 );
+    uint8_t lo[Rec::KEY_LEN], hi[Rec::KEY_LEN];
+    parse_key( cmd.substr( 5, i - 5 ), lo );
+    parse_key( cmd.substr( i + 1, j - i - 1 ), hi );
+    auto lim = atol( cmd.substr( j + 1 ).c_str() );
+
+    auto start = chrono::high_resolution_clock::now();
+    auto recs = c.ReadRange( lo, hi, lim );
+    auto end = chrono::high_resolution_clock::now();
+    auto dur = chrono::duration_cast<chrono::milliseconds>( end - start ).count();
+    if ( recs.size() > 0 ) {
+      print( "\nkeys-first", recs.front() );
+      print( "keys-last", recs.back() );
+    }
+    print( "\ncmd-keys", dur, recs.size() );
+
   } else if ( cmd.find_first_of( "range-" ) == 0 ) {
     size_t i = cmd.find_last_of( '-' );
     auto siz = atol( cmd.substr( i + 1 ).c_str() );
@@ -0,0 +1,62 @@
+/**
+ * Check reads bounded by the method1::Node adaptive index: read the first n
+ * records, then the first n - 1, which must be bounded by the record the
+ * first read ended at, yet still return all n - 1 (even when that record's
+ * key is shared with those before it).
+ */
+#include <iostream>
+#include <system_error>
+#include <vector>
+
+#include "record.hh"
+#include "node.hh"
+
+using namespace std;
+using namespace meth1;
+
+void run( vector<string> files, uint64_t maxn )
+{
+  Node node{files, "0", true};
+  node.Initialize();
+
+  for ( uint64_t n = 2; n <= maxn and n <= node.Size(); n++ ) {
+    vector<Record> first;
+    for ( auto & r : node.Read( 0, n ) ) {
+      first.emplace_back( Rec::MIN );
+      first.back().copy( r );
+    }
+
+    auto recs = node.Read( 0, n - 1 );
+    if ( first.size() != n or recs.size() != n - 1 ) {
+      throw runtime_error( "Read of " + to_string( n - 1 ) + " records got "
+        + to_string( recs.size() ) );
+    }
+    for ( uint64_t i = 0; i < n - 1; i++ ) {
+      if ( first[i].compare( recs[i] ) != 0 ) {
+        throw runtime_error( "Read of " + to_string( n - 1 )
+          + " records differs at " + to_string( i ) );
+      }
+    }
+  }
+  cout << "crack: ok" << endl;
+}
+
+void check_usage( const int argc, const char * const argv[] )
+{
+  if ( argc < 3 ) {
+    throw runtime_error( "Usage: " + string( argv[0] ) +
+                         " [max records] [file...]" );
+  }
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    check_usage( argc, argv );
+    run( {argv+2, argv+argc}, stoul( argv[1] ) );
+  } catch ( const exception & e ) {
+    std::cerr << e.what() << std::endl;
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
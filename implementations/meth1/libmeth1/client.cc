@@ -1,3 +1,4 @@
+#include <cstring>
 #include <iostream>
 
 #include "buffered_io.hh"
@@ -43,6 +44,25 @@ void Client::sendRead( uint64_t pos, uint64_t siz )
   sock_.write_all( data, sizeof( data ) );
 }
 
+void Client::sendReadRange( const uint8_t * lo, uint64_t skip,
+                            const uint8_t * hi, uint64_t limit )
+{
+  rpcStart_ = time_now();
+  rpcPos_ = 0;
+
+  print( "read-range-start", sock_.fd_num(), ++sendPass_, limit,
+    timestamp<ms>() );
+
+  char data[1 + 2 * Rec::KEY_LEN + 2 * sizeof( uint64_t )];
+  data[0] = RPC::READ_RANGE;
+  memcpy( data + 1, lo, Rec::KEY_LEN );
+  memcpy( data + 1 + Rec::KEY_LEN, hi, Rec::KEY_LEN );
+  *reinterpret_cast<uint64_t *>( data + 1 + 2 * Rec::KEY_LEN ) = limit;
+  *reinterpret_cast<uint64_t *>( data + 1 + 2 * Rec::KEY_LEN
+                                 + sizeof( uint64_t ) ) = skip;
+  sock_.write_all( data, sizeof( data ) );
+}
+
 uint64_t Client::recvRead( void )
 {
   print( "read-wait", sock_.fd_num(), ++recvPass_, time_diff<ms>( rpcStart_ ) );
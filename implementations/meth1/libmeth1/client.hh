@@ -46,6 +46,11 @@ public:
   void sendRead( uint64_t pos, uint64_t size );
   uint64_t recvRead( void );
 
+  /* Perform a key-range read of keys in [lo, hi), skipping the first skip of
+   * them. Receive with recvRead. */
+  void sendReadRange( const uint8_t * lo, uint64_t skip, const uint8_t * hi,
+                      uint64_t limit );
+
   /* Return the number of records available at this server */
   void sendSize( void );
   uint64_t recvSize( void );
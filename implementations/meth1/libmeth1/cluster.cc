@@ -1,3 +1,7 @@
+#include <algorithm>
+#include <cstring>
+#include <iterator>
+
 #include "tune_knobs.hh"
 
 #include "buffered_io.hh"
@@ -147,6 +151,80 @@ void Cluster::Read( uint64_t pos, uint64_t size )
   }
 }
 
+vector<Record> Cluster::ReadRange( const uint8_t * lo, const uint8_t * hi,
+                                   uint64_t limit )
+{
+  struct Tagged
+  {
+    Record rec;
+    uint64_t node;
+
+    bool operator<( const Tagged & b ) const { return rec < b.rec; }
+  };
+
+  // each node returns its smallest records in range, so the smallest of them
+  // all are the smallest overall. We page through a chunk at a time, each node
+  // resuming from the last key we took from it, skipping the records with
+  // that key we already have (so duplicates across a page boundary survive).
+  uint64_t nodes = clients_.size();
+  vector<string> from( nodes, string( (const char *) lo, Rec::KEY_LEN ) );
+  vector<uint64_t> skip( nodes, 0 );
+  vector<bool> done( nodes, false );
+  vector<uint64_t> got( nodes ), took( nodes );
+  vector<Record> out;
+
+  while ( out.size() < limit and count( done.begin(), done.end(), false ) ) {
+    uint64_t most = *max_element( skip.begin(), skip.end() );
+    if ( most >= chunkSize_ ) {
+      throw runtime_error( "Too many duplicate keys to page past" );
+    }
+    uint64_t n = min( limit - out.size(), chunkSize_ - most );
+    for ( uint64_t i = 0; i < nodes; i++ ) {
+      if ( not done[i] ) {
+        clients_[i].sendReadRange( (const uint8_t *) from[i].data(), skip[i],
+                                   hi, n );
+      }
+    }
+
+    vector<Tagged> recs;
+    for ( uint64_t i = 0; i < nodes; i++ ) {
+      got[i] = took[i] = 0;
+      if ( done[i] ) {
+        continue;
+      }
+      got[i] = clients_[i].recvRead();
+      string data = clients_[i].socket().read_all( got[i] * Rec::SIZE );
+      size_t mid = recs.size();
+      for ( uint64_t j = 0; j < got[i]; j++ ) {
+        recs.push_back( {Record( data.data() + j * Rec::SIZE ), i} );
+      }
+      inplace_merge( recs.begin(), recs.begin() + mid, recs.end() );
+    }
+
+    uint64_t take = min( n, uint64_t( recs.size() ) );
+    for ( uint64_t j = 0; j < take; j++ ) {
+      Tagged & t = recs[j];
+      if ( memcmp( t.rec.key(), from[t.node].data(), Rec::KEY_LEN ) == 0 ) {
+        skip[t.node]++;
+      } else {
+        from[t.node].assign( (const char *) t.rec.key(), Rec::KEY_LEN );
+        skip[t.node] = 1;
+      }
+      took[t.node]++;
+      out.push_back( move( t.rec ) );
+    }
+
+    // a node is done once it ran out within this page and we took it all
+    for ( uint64_t i = 0; i < nodes; i++ ) {
+      if ( got[i] < n and took[i] == got[i] ) {
+        done[i] = true;
+      }
+    }
+  }
+
+  return out;
+}
+
 void Cluster::ReadAll( void )
 {
   if ( clients_.size() == 1 ) {
@@ -40,6 +40,10 @@ public:
   Record ReadFirst( void );
   void Read( uint64_t pos, uint64_t size );
   void ReadAll( void );
+
+  /* Smallest (up to) limit records with keys in [lo, hi) */
+  std::vector<Record> ReadRange( const uint8_t * lo, const uint8_t * hi,
+                                 uint64_t limit );
   void WriteAll( File out );
   void Shutdown( void );
 };
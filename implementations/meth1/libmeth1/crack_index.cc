@@ -0,0 +1,112 @@
+#include <cstring>
+
+#include "crack_index.hh"
+
+using namespace std;
+using namespace meth1;
+
+CrackIndex::CrackIndex( void )
+  : bounds_{}
+  , pieces_{}
+  , order_{}
+  , pieceRecs_{0}
+{}
+
+void CrackIndex::add_bound( uint64_t pos, const RR & r )
+{
+  if ( bounds_.size() >= MAX_BOUNDS and bounds_.count( pos ) == 0 ) {
+    return;
+  }
+  bounds_[pos].copy( r );
+}
+
+void CrackIndex::add_piece( uint64_t pos, RecV & recs )
+{
+  uint64_t n = recs.size();
+  if ( n == 0 or n > PIECE_RECS or pieces_.count( pos ) != 0 ) {
+    return;
+  }
+
+  // evict oldest pieces until this one fits
+  while ( pieceRecs_ + n > PIECE_RECS ) {
+    auto it = pieces_.find( order_.front() );
+    pieceRecs_ -= it->second.size;
+    pieces_.erase( it );
+    order_.pop_front();
+  }
+
+  Piece p{n, unique_ptr<RR[]>( new RR[n] )};
+  for ( uint64_t i = 0; i < n; i++ ) {
+    p.recs[i].copy( recs[i] );
+  }
+  pieces_.emplace( pos, move( p ) );
+  order_.push_back( pos );
+  pieceRecs_ += n;
+}
+
+void CrackIndex::add( uint64_t pos, RecV & recs )
+{
+  uint64_t n = recs.size();
+  if ( n == 0 ) {
+    return;
+  }
+
+  // strided positions are absolute so reads chunked the same way share them
+  for ( uint64_t p = ( pos / STRIDE + 1 ) * STRIDE; p < pos + n; p += STRIDE ) {
+    add_bound( p, recs[p - pos - 1] );
+  }
+  add_bound( pos + n, recs[n - 1] );
+
+  if ( PIECE_RECS > 0 ) {
+    add_piece( pos, recs );
+  }
+}
+
+uint64_t CrackIndex::floor( uint64_t pos, Record & after ) const
+{
+  auto it = bounds_.upper_bound( pos );
+  if ( it == bounds_.begin() ) {
+    after = Record( Rec::MIN );
+    return 0;
+  }
+  --it;
+  after.copy( it->second );
+  return it->first;
+}
+
+bool CrackIndex::upper( uint64_t end, RR & bound ) const
+{
+  // bound at position q is the record at q - 1, which needs to be >= end - 1.
+  // Records compare by key alone, so those before it may share its key: bound
+  // by the next key up instead, which sorts after them all.
+  auto it = bounds_.lower_bound( end );
+  if ( it == bounds_.end() ) {
+    return false;
+  }
+  uint8_t key[Rec::KEY_LEN];
+  memcpy( key, it->second.key(), Rec::KEY_LEN );
+  int i = Rec::KEY_LEN - 1;
+  for ( ; i >= 0 and key[i] == 0xFF; i-- ) {
+    key[i] = 0x00;
+  }
+  if ( i < 0 ) {
+    return false;
+  }
+  key[i]++;
+  bound.copy( key, it->second.val(), it->second.loc() );
+  return true;
+}
+
+bool CrackIndex::lookup( uint64_t pos, uint64_t size, RecV & recs )
+{
+  auto it = pieces_.upper_bound( pos );
+  if ( it == pieces_.begin() ) {
+    return false;
+  }
+  --it;
+  if ( it->first + it->second.size < pos + size ) {
+    return false;
+  }
+  recs = RecV( it->second.recs.get() + ( pos - it->first ), size, false );
+  return true;
+}
@@ -0,0 +1,87 @@
+#ifndef METH1_CRACK_INDEX_HH
+#define METH1_CRACK_INDEX_HH
+
+#include <deque>
+#include <map>
+#include <memory>
+
+#include "tune_knobs.hh"
+
+#include "raw_vector.hh"
+
+#include "record.hh"
+
+namespace meth1
+{
+
+/**
+ * Adaptive index ("database cracking") for a node: rather than building an
+ * index up front, each read leaves behind what it learnt about the sorted
+ * order, which later reads reuse.
+ *
+ * - Bounds: the record just before a position (sorted order) for positions
+ *   reads started or ended at, plus every STRIDE'th position within them. A
+ *   read seeks from the nearest bound at or before its start, rather than from
+ *   the first record, and bounds its scan from above by the nearest one after
+ *   its end.
+ * - Pieces (optional): copies of the records past reads returned, so a later
+ *   read falling within one needs no scan at all.
+ */
+class CrackIndex
+{
+public:
+  using RR = RecordS;
+  using RecV = RawVector<RR>;
+
+  static constexpr bool ENABLED = Knobs::ADAPTIVE_INDEX;
+  static constexpr uint64_t STRIDE = Knobs::ADAPTIVE_INDEX_STRIDE;
+  static constexpr uint64_t MAX_BOUNDS = Knobs::ADAPTIVE_INDEX_BOUNDS;
+  static constexpr uint64_t PIECE_RECS = Knobs::ADAPTIVE_INDEX_PIECES;
+
+private:
+  struct Piece
+  {
+    uint64_t size;
+    std::unique_ptr<RR[]> recs;
+  };
+
+  /* position -> record at position - 1 */
+  std::map<uint64_t, Record> bounds_;
+
+  /* position -> records from there, oldest first in order_ */
+  std::map<uint64_t, Piece> pieces_;
+  std::deque<uint64_t> order_;
+  uint64_t pieceRecs_;
+
+  void add_bound( uint64_t pos, const RR & r );
+  void add_piece( uint64_t pos, RecV & recs );
+
+public:
+  CrackIndex( void );
+
+  /* no copy */
+  CrackIndex( const CrackIndex & ) = delete;
+  CrackIndex & operator=( const CrackIndex & ) = delete;
+
+  /* Remember the records a scan found starting at position pos */
+  void add( uint64_t pos, RecV & recs );
+
+  /* Nearest position at or before pos whose preceding record we know, setting
+   * after to that record (the min record for position 0) */
+  uint64_t floor( uint64_t pos, Record & after ) const;
+
+  /* Find a record (strictly) above all the records before position end, by
+   * key alone. False if we don't know of one. */
+  bool upper( uint64_t end, RR & bound ) const;
+
+  /* Set recs to records [pos, pos + size) if a piece holds them all. The
+   * records stay owned by the index, and are valid until the next add. */
+  bool lookup( uint64_t pos, uint64_t size, RecV & recs );
+
+  size_t bounds( void ) const noexcept { return bounds_.size(); }
+  size_t pieces( void ) const noexcept { return pieces_.size(); }
+};
+
+}
+
+#endif /* METH1_CRACK_INDEX_HH */
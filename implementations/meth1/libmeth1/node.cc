@@ -1,3 +1,4 @@
+#include <cstring>
 #include <numeric>
 
 #include "tune_knobs.hh"
@@ -22,6 +23,7 @@ Node::Node( vector<string> files, string port, bool odirect )
 #else
   : recios_{}
 #endif
+  , index_{}
   , port_{port}
   , last_{Rec::MIN}
   , fpos_{0}
@@ -71,6 +73,9 @@ void Node::Run( void )
         case RPC::MAX_CHUNK:
           RPC_MaxChunk( client );
           break;
+        case RPC::READ_RANGE:
+          RPC_ReadRange( client );
+          break;
         case RPC::EXIT:
           print( "\nexit", timestamp<ms>() );
           return;
@@ -88,11 +93,6 @@ void Node::Run( void )
 
 void Node::RPC_Read( TCPSocket & client )
 {
-  static uint64_t pass = 0;
-
-  static char * buf1 = new char[Knobs::IO_BUFFER_NETW * Rec::SIZE];
-  static char * buf2 = new char[Knobs::IO_BUFFER_NETW * Rec::SIZE];
-
   constexpr size_t rpcSize = 2 * sizeof( uint64_t );
   char strArray[rpcSize];
   char * rpcData = strArray; // work-around strict-aliasing rules
@@ -106,6 +106,35 @@ void Node::RPC_Read( TCPSocket & client )
   if ( pos < Size() ) {
     recs = Read( pos, amt );
   }
+  write_recs( client, recs );
+}
+
+void Node::RPC_ReadRange( TCPSocket & client )
+{
+  constexpr size_t rpcSize = 2 * Rec::KEY_LEN + 2 * sizeof( uint64_t );
+  char strArray[rpcSize];
+  char * rpcData = strArray; // work-around strict-aliasing rules
+
+  client.read_all( rpcData, rpcSize );
+
+  const uint8_t * lo = reinterpret_cast<const uint8_t *>( rpcData );
+  const uint8_t * hi = lo + Rec::KEY_LEN;
+  uint64_t limit =
+    *( reinterpret_cast<const uint64_t *>( rpcData + 2 * Rec::KEY_LEN ) );
+  uint64_t skip =
+    *( reinterpret_cast<const uint64_t *>( rpcData + 2 * Rec::KEY_LEN ) + 1 );
+
+  RecV recs = ReadRange( lo, skip, hi, limit );
+  write_recs( client, recs );
+}
+
+/* Send a count and then the records */
+void Node::write_recs( TCPSocket & client, RecV & recs )
+{
+  static uint64_t pass = 0;
+
+  static char * buf1 = new char[Knobs::IO_BUFFER_NETW * Rec::SIZE];
+  static char * buf2 = new char[Knobs::IO_BUFFER_NETW * Rec::SIZE];
 
   auto t0 = time_now();
   uint64_t siz = recs.size();
@@ -201,12 +230,75 @@ Node::RecV Node::Read( uint64_t pos, uint64_t size )
   print( "\nread-start", ++pass, pos, size, timestamp<ms>() );
 
   auto t0 = time_now();
-  auto recs = linear_scan( seek( pos ), size );
+  RecV recs;
+  if ( CrackIndex::ENABLED and index_.lookup( pos, size, recs ) ) {
+    print( "read-cached", pass );
+  } else {
+    const Record & after = seek( pos );
+    RR bound;
+    if ( CrackIndex::ENABLED and index_.upper( pos + size, bound ) ) {
+      recs = linear_scan( after, size, &bound );
+    } else {
+      recs = linear_scan( after, size );
+    }
+    if ( CrackIndex::ENABLED ) {
+      index_.add( pos, recs );
+    }
+  }
   if ( recs.size() > 0 ) {
     last_.copy( recs.back() );
     fpos_ = pos + recs.size();
   }
   print( "read", pass, recs.size(), time_diff<ms>( t0 ) );
+  if ( CrackIndex::ENABLED ) {
+    print( "adaptive-index", pass, index_.bounds(), index_.pieces() );
+  }
+
+  return recs;
+}
+
+Node::RecV Node::ReadRange( const uint8_t * lo, uint64_t skip,
+                            const uint8_t * hi, uint64_t limit )
+{
+  static size_t pass = 0;
+  if ( skip + limit > seek_chunk_ ) {
+    print( "chunk-too-large", skip + limit, seek_chunk_ );
+    throw runtime_error( "Requested read is too large" );
+  }
+  if ( limit == 0 or memcmp( lo, hi, Rec::KEY_LEN ) >= 0 ) {
+    return {nullptr, 0};
+  }
+
+  print( "\nread-range-start", ++pass, limit, timestamp<ms>() );
+  auto t0 = time_now();
+
+  // scan for records after the key just before lo (at its last location),
+  // and before hi (at its first), which is a single filtered scan as for a
+  // position read, just without needing to seek first
+  uint8_t key[Rec::SIZE] = {0};
+  memcpy( key, lo, Rec::KEY_LEN );
+  int i = Rec::KEY_LEN - 1;
+  for ( ; i >= 0 and key[i] == 0x00; i-- ) {
+    key[i] = 0xFF;
+  }
+  Record after( Rec::MIN );
+  if ( i >= 0 ) {
+    key[i]--;
+    after.copy( key, UINT64_MAX );
+  }
+
+  memcpy( key, hi, Rec::KEY_LEN );
+  RR bound;
+  bound.copy( key, 0 );
+
+  RecV recs = linear_scan_chunk( after, skip + limit, &bound );
+  if ( recs.size() <= skip ) {
+    recs.size() = 0;
+  } else if ( skip > 0 ) {
+    move( recs.begin() + skip, recs.end(), recs.begin() );
+    recs.size() -= skip;
+  }
+  print( "read-range", pass, recs.size(), time_diff<ms>( t0 ) );
 
   return recs;
 }
@@ -229,13 +321,28 @@ Record Node::seek( uint64_t pos )
   } else if ( pos >= Size() ) {
     last_ = Record( Rec::MAX );
   } else if ( fpos_ != pos ) {
-    // remember, retrieving the record just before `pos`
-    for ( uint64_t i = 0; i < pos; i += seek_chunk_ ) {
-      auto recs = linear_scan( Record{Rec::MIN}, min( pos - i, seek_chunk_ ) );
+    // remember, retrieving the record just before `pos`, starting from the
+    // closest position before it we know the record for
+    uint64_t from = 0;
+    if ( CrackIndex::ENABLED ) {
+      from = index_.floor( pos, last_ );
+    } else {
+      last_ = Record( Rec::MIN );
+    }
+    RR bound;
+    bool bounded = CrackIndex::ENABLED and index_.upper( pos, bound );
+    print( "seek", pos, from );
+
+    for ( uint64_t i = from; i < pos; i += seek_chunk_ ) {
+      auto recs = linear_scan( last_, min( pos - i, seek_chunk_ ),
+                               bounded ? &bound : nullptr );
       if ( recs.size() == 0 ) {
         break;
       }
       last_.copy( recs.back() );
+      if ( CrackIndex::ENABLED ) {
+        index_.add( i, recs );
+      }
     }
   }
   return last_;
@@ -243,12 +350,13 @@ Record Node::seek( uint64_t pos )
 
 /* Perform a single linear scan of the file, returning the next `size` smallest
  * records that occur directly after the `after` record. */
-Node::RecV Node::linear_scan( const Record & after, uint64_t size )
+Node::RecV Node::linear_scan( const Record & after, uint64_t size,
+                              const RR * bound )
 {
   if ( size == 1 ) {
     return linear_scan_one( after );
   } else {
-    return linear_scan_chunk( after, size );
+    return linear_scan_chunk( after, size, bound );
   }
 }
 
@@ -263,7 +371,7 @@ Node::RecV Node::linear_scan_one( const Record & after )
     RecLoader & rio = recios_[i];
     RR * rr_i = &rr[i];
 
-    rio.rewind();
+    rio.rewind( after );
 #ifdef HAVE_TBB_TASK_GROUP_H
     tg_.run( [&rio, &after, rr_i]() {
 
@@ -312,22 +420,23 @@ Node::RecV Node::linear_scan_one( const Record & after )
   return {move( rec )};
 }
 
-/* Linear scan using a chunked sorting + merge strategy. */
+/* Linear scan using a chunked sorting + merge strategy. If given, all the
+ * records wanted are known to sort before `bound`. */
 Node::RecV Node::linear_scan_chunk( const Record & after, uint64_t size,
-    RR * r1, RR * r2, RR *r3, uint64_t r1x )
+    const RR * bound, RR * r1, RR * r2, RR *r3, uint64_t r1x )
 {
   auto t0 = time_now();
   tdiff_t tm = 0, ts = 0, tl = 0;
   size_t merges = 0, sorts = 0;
 
-  const RR * curMin = nullptr;
+  const RR * curMin = bound;
   const uint64_t r1x_i = r1x / recios_.size();
   vector<uint64_t> r1s_i( recios_.size() );
   uint64_t r2s = 0;
 
   // kick of all readers
   for ( auto & rio : recios_ ) {
-    rio.rewind();
+    rio.rewind( after );
   }
 
   while ( true ) {
@@ -420,7 +529,8 @@ void Node::free_buffers( Node::RR * r1, Node::RR * r3, size_t size )
 }
 
 /* Memory management for linear_scan_chunk */
-Node::RecV Node::linear_scan_chunk( const Record & after, uint64_t size )
+Node::RecV Node::linear_scan_chunk( const Record & after, uint64_t size,
+                                    const RR * bound )
 {
   if ( size == 0 ) {
     return {nullptr, 0};
@@ -443,7 +553,9 @@ Node::RecV Node::linear_scan_chunk( const Record & after, uint64_t size )
       gr2 = new RR[gr2x];
       gr3 = new RR[gr2x];
     } else if ( Knobs::USE_COPY ) {
-      for ( uint64_t i = 0; i < size; i++ ) {
+      // clear all of r3, not just `size`, as an earlier, larger scan may have
+      // left cells past it sharing storage too
+      for ( uint64_t i = 0; i < gr2x; i++ ) {
         gr3[i].set_val( nullptr );
       }
     }
@@ -456,7 +568,7 @@ Node::RecV Node::linear_scan_chunk( const Record & after, uint64_t size )
     r3 = new RR[size];
   }
 
-  auto rr = linear_scan_chunk( after, size, r1, r2, r3, r1x );
+  auto rr = linear_scan_chunk( after, size, bound, r1, r2, r3, r1x );
   if ( rr.data() == r3 ) {
     swap( r2, r3 );
     if ( Knobs::REUSE_MEM ) {
@@ -17,10 +17,13 @@
 #include "record.hh"
 #include "rec_loader.hh"
 
+#include "crack_index.hh"
+
 /**
  * Stratergy 1.
  * - No upfront work.
  * - Full linear scan for each record.
+ * - Reads leave behind an adaptive index that later reads scan less with.
  */
 namespace meth1
 {
@@ -39,6 +42,7 @@ private:
   tbb::task_group tg_;
 #endif
   std::vector<RecLoader> recios_;
+  CrackIndex index_;
   std::string port_;
   Record last_;
   uint64_t fpos_;
@@ -83,16 +87,27 @@ public:
   RecV Read( uint64_t pos, uint64_t size );
   uint64_t Size( void );
 
+  /* Smallest (up to) limit records with keys in [lo, hi), after skipping the
+   * first skip of them */
+  RecV ReadRange( const uint8_t * lo, uint64_t skip, const uint8_t * hi,
+                  uint64_t limit );
+
 private:
   Record seek( uint64_t pos );
 
-  RecV linear_scan( const Record & after, uint64_t size = 1 );
+  RecV linear_scan( const Record & after, uint64_t size = 1,
+                    const RR * bound = nullptr );
   RecV linear_scan_one( const Record & after );
   RecV linear_scan_chunk( const Record & after, uint64_t size,
-                          RR * r1, RR * r2, RR *r3, uint64_t r1x );
-  RecV linear_scan_chunk( const Record & after, uint64_t size );
+                          const RR * bound, RR * r1, RR * r2, RR *r3,
+                          uint64_t r1x );
+  RecV linear_scan_chunk( const Record & after, uint64_t size,
+                          const RR * bound );
+
+  void write_recs( TCPSocket & client, RecV & recs );
 
   void RPC_Read( TCPSocket & client );
+  void RPC_ReadRange( TCPSocket & client );
   void RPC_Size( TCPSocket & client );
   void RPC_MaxChunk( TCPSocket & client );
 };
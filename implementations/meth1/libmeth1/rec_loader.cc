@@ -2,20 +2,53 @@
 
 #include "rec_loader.hh"
 
-void RecLoader::rewind( void )
+RecLoader::RecLoader( std::string fileName, int flags, bool odirect )
+  : file_{new File( fileName, flags, odirect ? File::DIRECT : File::CACHED )}
+  , rio_{new RecIO( *file_, Knobs::DISK_BLOCKS )}
+  , zones_{nullptr}
+  , eof_{false}
+  , loc_{0}
+{
+  if ( ZoneMap::ENABLED ) {
+    ZoneMap * zones = new ZoneMap( fileName, file_->size() );
+    zones_.reset( zones );
+    rio_->set_skip_cb( [zones]( size_t off ) { return zones->skip( off ); } );
+  }
+}
+
+void RecLoader::rewind( const Record & after )
 {
   loc_ = 0;
   eof_ = false;
+  if ( zones_ ) {
+    zones_->start_scan( after.key() );
+  }
   rio_->rewind();
 }
 
-RecordPtr RecLoader::next_record( void )
+const uint8_t * RecLoader::next( void )
 {
-  const char * r = rio_->next_record();
+  const uint8_t * r = (const uint8_t *) rio_->next_record();
   if ( r == nullptr ) {
     eof_ = true;
+    if ( zones_ ) {
+      zones_->finish_scan();
+    }
+    return r;
   }
-  return {r, loc_++};
+
+  // zones the reader skipped leave gaps, so can't just count records
+  loc_ = rio_->rec_offset() / Rec::SIZE;
+  if ( zones_ ) {
+    zones_->add( r, loc_ );
+  }
+  return r;
+}
+
+RecordPtr RecLoader::next_record( void )
+{
+  const uint8_t * r = next();
+  return {r, loc_};
 }
 
 uint64_t RecLoader::filter( RR * r1, uint64_t size, const Record & after,
@@ -26,10 +59,9 @@ uint64_t RecLoader::filter( RR * r1, uint64_t size, const Record & after,
   }
 
   if ( curMin == nullptr ) {
-    for ( uint64_t i = 0; i < size; loc_++ ) {
-      const uint8_t * r = (const uint8_t *) rio_->next_record();
+    for ( uint64_t i = 0; i < size; ) {
+      const uint8_t * r = next();
       if ( r == nullptr ) {
-        eof_ = true;
         return i;
       }
       if ( after.compare( r, loc_ ) < 0 ) {
@@ -40,10 +72,12 @@ uint64_t RecLoader::filter( RR * r1, uint64_t size, const Record & after,
       }
     }
   } else {
-    for ( uint64_t i = 0; i < size; loc_++ ) {
-      const uint8_t * r = (const uint8_t *) rio_->next_record();
+    if ( zones_ ) {
+      zones_->tighten( curMin->key() );
+    }
+    for ( uint64_t i = 0; i < size; ) {
+      const uint8_t * r = next();
       if ( r == nullptr ) {
-        eof_ = true;
         return i;
       }
       if ( after.compare( r, loc_ ) < 0 and
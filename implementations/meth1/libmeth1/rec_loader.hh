@@ -10,6 +10,7 @@
 #include "overlapped_rec_io.hh"
 
 #include "record.hh"
+#include "zone_map.hh"
 
 class RecLoader
 {
@@ -20,16 +21,15 @@ public:
 private:
   std::unique_ptr<File> file_;
   std::unique_ptr<RecIO> rio_;
+  std::unique_ptr<ZoneMap> zones_;
   bool eof_;
   uint64_t loc_;
 
+  /* next record of the file (nullptr at EOF), tracking its location */
+  const uint8_t * next( void );
+
 public:
-  RecLoader( std::string fileName, int flags, bool odirect )
-    : file_{new File( fileName, flags, odirect ? File::DIRECT : File::CACHED )}
-    , rio_{new RecIO( *file_, Knobs::DISK_BLOCKS )}
-    , eof_{false}
-    , loc_{0}
-  {}
+  RecLoader( std::string fileName, int flags, bool odirect );
 
   /* no copy */
   RecLoader( const RecLoader & ) = delete;
@@ -39,6 +39,7 @@ public:
   RecLoader( RecLoader && other )
     : file_{std::move( other.file_ )}
     , rio_{std::move( other.rio_ )}
+    , zones_{std::move( other.zones_ )}
     , eof_{other.eof_}
     , loc_{other.loc_}
   {}
@@ -48,6 +49,7 @@ public:
     if ( this != &other ) {
       file_ = std::move( other.file_ );
       rio_ = std::move( other.rio_ );
+      zones_ = std::move( other.zones_ );
       eof_ = other.eof_;
       loc_ = other.loc_;
     }
@@ -57,7 +59,9 @@ public:
   int id( void ) const noexcept { return file_->fd_num(); }
   uint64_t records( void ) const noexcept { return file_->size() / Rec::SIZE; }
   bool eof( void ) const noexcept { return eof_; }
-  void rewind( void );
+
+  /* start a new scan, for records after the one given */
+  void rewind( const Record & after );
 
   RecordPtr next_record( void );
   uint64_t filter( RR * r1, uint64_t size, const Record & after,
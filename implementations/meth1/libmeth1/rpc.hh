@@ -10,7 +10,8 @@ enum RPC : int8_t {
   READ,
   SIZE,
   MAX_CHUNK,
-  EXIT
+  EXIT,
+  READ_RANGE
 };
 
 }
@@ -0,0 +1,160 @@
+#include <sys/stat.h>
+
+#include <cstring>
+
+#include "exception.hh"
+#include "file.hh"
+#include "sync_print.hh"
+
+#include "zone_map.hh"
+
+using namespace std;
+
+/* Persisted as <header, zones> in `<file>.zones` */
+struct ZoneHeader
+{
+  uint64_t fsize;
+  int64_t mtime;
+  uint64_t zoneBytes;
+  uint64_t zones;
+};
+
+ZoneMap::ZoneMap( string path, uint64_t fsize )
+  : path_{path}
+  , fsize_{fsize}
+  , mtime_{0}
+  , zones_( ( fsize + ZONE_BYTES - 1 ) / ZONE_BYTES )
+  , ready_{false}
+  , building_{false}
+  , mtx_{}
+  , bounded_{false}
+  , skipped_{0}
+{
+  memset( after_, 0, sizeof( after_ ) );
+  memset( bound_, 0, sizeof( bound_ ) );
+
+  struct stat st;
+  SystemCall( "stat", ::stat( path_.c_str(), &st ) );
+  mtime_ = int64_t( st.st_mtim.tv_sec ) * 1000000000 + st.st_mtim.tv_nsec;
+
+  if ( PERSIST ) {
+    load();
+  }
+}
+
+void ZoneMap::start_scan( const uint8_t * after )
+{
+  unique_lock<mutex> lck( mtx_ );
+  memcpy( after_, after, Rec::KEY_LEN );
+  bounded_ = false;
+  skipped_ = 0;
+
+  if ( not ready_ ) {
+    building_ = true;
+    for ( auto & z : zones_ ) {
+      memset( z.min, 0xFF, Rec::KEY_LEN );
+      memset( z.max, 0x00, Rec::KEY_LEN );
+    }
+  }
+}
+
+void ZoneMap::tighten( const uint8_t * bound )
+{
+  if ( ready_ ) {
+    unique_lock<mutex> lck( mtx_ );
+    memcpy( bound_, bound, Rec::KEY_LEN );
+    bounded_ = true;
+  }
+}
+
+void ZoneMap::finish_scan( void )
+{
+  unique_lock<mutex> lck( mtx_ );
+  if ( building_ ) {
+    building_ = false;
+    ready_ = true;
+    print( "zone-map", path_, zones_.size() );
+    if ( PERSIST ) {
+      save();
+    }
+  } else if ( ready_ ) {
+    print( "zone-skip", path_, skipped_, zones_.size() );
+  }
+}
+
+/* Could a zone hold a key in (after, bound)? Keys only order records up to
+ * their location, so with locations a zone ending or starting on a bound key
+ * may still hold records in range. */
+bool ZoneMap::zone_wanted( const Zone & z ) const noexcept
+{
+#if WITHLOC == 1
+  return memcmp( z.max, after_, Rec::KEY_LEN ) >= 0
+    and ( not bounded_ or memcmp( z.min, bound_, Rec::KEY_LEN ) <= 0 );
+#else
+  return memcmp( z.max, after_, Rec::KEY_LEN ) > 0
+    and ( not bounded_ or memcmp( z.min, bound_, Rec::KEY_LEN ) < 0 );
+#endif
+}
+
+size_t ZoneMap::skip( size_t offset )
+{
+  unique_lock<mutex> lck( mtx_ );
+  if ( not ready_ or offset % ZONE_BYTES != 0 ) {
+    return 0;
+  }
+
+  size_t z = offset / ZONE_BYTES, z0 = z;
+  while ( z < zones_.size() and not zone_wanted( zones_[z] ) ) {
+    z++;
+  }
+  skipped_ += z - z0;
+  return ( z - z0 ) * ZONE_BYTES;
+}
+
+void ZoneMap::load( void )
+{
+  string path = path_ + ".zones";
+  struct stat st;
+  if ( ::stat( path.c_str(), &st ) != 0 ) {
+    return;
+  }
+
+  File file( path, O_RDONLY );
+  string hdr = file.read_all( sizeof( ZoneHeader ) );
+  if ( hdr.size() != sizeof( ZoneHeader ) ) {
+    print( "zone-map-stale", path );
+    return;
+  }
+  ZoneHeader h;
+  memcpy( &h, hdr.data(), sizeof( h ) );
+  if ( h.fsize != fsize_ or h.mtime != mtime_ or h.zoneBytes != ZONE_BYTES
+      or h.zones != zones_.size() ) {
+    print( "zone-map-stale", path );
+    return;
+  }
+
+  size_t len = zones_.size() * sizeof( Zone );
+  if ( len > 0 and file.read_all( (char *) zones_.data(), len ) != len ) {
+    print( "zone-map-stale", path );
+    return;
+  }
+  ready_ = true;
+  print( "zone-map-loaded", path, zones_.size() );
+}
+
+void ZoneMap::save( void )
+{
+  string path = path_ + ".zones";
+  try {
+    ZoneHeader h{fsize_, mtime_, ZONE_BYTES, zones_.size()};
+    File file( path, O_WRONLY | O_CREAT | O_TRUNC, 0644 );
+    file.write_all( (const char *) &h, sizeof( h ) );
+    if ( not zones_.empty() ) {
+      file.write_all( (const char *) zones_.data(),
+        zones_.size() * sizeof( Zone ) );
+    }
+  } catch ( const exception & e ) {
+    // just means rebuilding it next run
+    print( "zone-map-save-failed", path, e.what() );
+  }
+}
@@ -0,0 +1,109 @@
+#ifndef ZONE_MAP_HH
+#define ZONE_MAP_HH
+
+#include <atomic>
+#include <cstdint>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "tune_knobs.hh"
+
+#include "circular_io.hh"
+
+#include "record.hh"
+
+static constexpr uint64_t zone_gcd( uint64_t a, uint64_t b )
+{
+  return b == 0 ? a : zone_gcd( b, a % b );
+}
+
+/**
+ * A zone map for a file of records: the min and max key of each zone (a run
+ * of CircularIO blocks) of the file. The first full scan of the file builds
+ * it, after which a scan for keys in (after, bound) can skip reading any zone
+ * whose keys all lie outside that range. The bound tightens as a scan goes,
+ * so the reader checks it just before reading each zone.
+ */
+class ZoneMap
+{
+public:
+  static constexpr bool ENABLED = Knobs::ZONE_MAPS;
+  static constexpr bool PERSIST = Knobs::ZONE_MAPS_PERSIST;
+
+  /* smallest run of blocks that is also a whole number of records, so zones
+   * start and end on both block and record boundaries */
+  static constexpr uint64_t ZONE_BYTES = CircularIO::BLOCK
+    * ( Rec::SIZE / zone_gcd( CircularIO::BLOCK, Rec::SIZE ) );
+  static constexpr uint64_t ZONE_RECS = ZONE_BYTES / Rec::SIZE;
+
+  static_assert( ZONE_BYTES % Rec::SIZE == 0, "zones hold whole records" );
+
+private:
+  struct Zone
+  {
+    uint8_t min[Rec::KEY_LEN];
+    uint8_t max[Rec::KEY_LEN];
+  };
+
+  std::string path_;
+  uint64_t fsize_;
+  int64_t mtime_;
+  std::vector<Zone> zones_;
+
+  /* complete, or being built by the current scan -- atomic as the reader
+   * thread checks them while the scan sets them, and setting ready_ publishes
+   * the zones the scan built */
+  std::atomic<bool> ready_;
+  std::atomic<bool> building_;
+
+  /* current scan's range, guarded as the reader thread checks it */
+  std::mutex mtx_;
+  uint8_t after_[Rec::KEY_LEN];
+  uint8_t bound_[Rec::KEY_LEN];
+  bool bounded_;
+  uint64_t skipped_;
+
+  bool zone_wanted( const Zone & z ) const noexcept;
+  void load( void );
+  void save( void );
+
+public:
+  /* For the file at path given, of fsize bytes */
+  ZoneMap( std::string path, uint64_t fsize );
+
+  /* no copy */
+  ZoneMap( const ZoneMap & ) = delete;
+  ZoneMap & operator=( const ZoneMap & ) = delete;
+
+  bool ready( void ) const noexcept { return ready_; }
+
+  /* Start a new scan of the file for keys after the one given */
+  void start_scan( const uint8_t * after );
+
+  /* Note the record at loc seen by the current scan */
+  void add( const uint8_t * key, uint64_t loc ) noexcept
+  {
+    if ( building_ ) {
+      Zone & z = zones_[loc / ZONE_RECS];
+      if ( std::memcmp( key, z.min, Rec::KEY_LEN ) < 0 ) {
+        std::memcpy( z.min, key, Rec::KEY_LEN );
+      }
+      if ( std::memcmp( key, z.max, Rec::KEY_LEN ) > 0 ) {
+        std::memcpy( z.max, key, Rec::KEY_LEN );
+      }
+    }
+  }
+
+  /* Current scan now only wants keys below the one given */
+  void tighten( const uint8_t * bound );
+
+  /* Current scan reached the end of the file */
+  void finish_scan( void );
+
+  /* Bytes from offset (a block boundary) the current scan can skip reading */
+  size_t skip( size_t offset );
+};
+
+#endif /* ZONE_MAP_HH */
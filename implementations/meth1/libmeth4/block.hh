@@ -24,6 +24,8 @@ public:
   block_t( const block_t & other )
     : buf{other.buf}, len{other.len}, bucket{other.bucket}
   {}
+
+  block_t & operator=( const block_t & other ) = default;
 };
 
 #endif /* METH4_BLOCK_HH */
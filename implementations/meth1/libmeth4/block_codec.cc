@@ -0,0 +1,145 @@
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+
+#include "config.h"
+#ifdef HAVE_LZ4_H
+#include <lz4.h>
+#endif
+
+#include "block_codec.hh"
+#include "buffer_pool.hh"
+
+using namespace std;
+
+BlockCodec::BlockCodec( size_t blockSize )
+  : blockSize_{blockSize}
+  , scratch_{nullptr}
+  , scratchLen_{0}
+  , key_{nullptr}
+  , prefix_{0}
+  , payload_{nullptr}
+  , left_{0}
+{
+#ifdef HAVE_LZ4_H
+  if ( ENABLED and COMPRESS ) {
+    scratchLen_ = LZ4_compressBound( blockSize );
+    scratch_ = blockPool().get( scratchLen_ );
+  }
+#endif
+}
+
+BlockCodec::BlockCodec( BlockCodec && other )
+  : blockSize_{other.blockSize_}
+  , scratch_{other.scratch_}
+  , scratchLen_{other.scratchLen_}
+  , key_{other.key_}
+  , prefix_{other.prefix_}
+  , payload_{other.payload_}
+  , left_{other.left_}
+{
+  other.scratch_ = nullptr;
+  other.scratchLen_ = 0;
+  other.left_ = 0;
+}
+
+BlockCodec::~BlockCodec( void )
+{
+  blockPool().put( scratch_ );
+}
+
+size_t BlockCodec::encode( const uint8_t * recs, size_t len, uint8_t * out )
+{
+  if ( len % Rec::SIZE != 0 or len > blockSize_ ) {
+    throw runtime_error( "Can't encode a block of " + to_string( len ) );
+  }
+
+  // longest key prefix all records share with the first
+  uint32_t n = len / Rec::SIZE;
+  size_t prefix = n > 0 ? Rec::KEY_LEN : 0;
+  for ( size_t i = 1; i < n and prefix > 0; i++ ) {
+    const uint8_t * key = recs + i * Rec::SIZE;
+    size_t j = 0;
+    while ( j < prefix and key[j] == recs[j] ) {
+      j++;
+    }
+    prefix = j;
+  }
+
+  memcpy( out, &n, sizeof( n ) );
+  out[sizeof( n )] = prefix;
+  out[sizeof( n ) + 1] = 0;
+  memcpy( out + HDRSIZE, recs, prefix );
+
+  uint8_t * payload = out + HDRSIZE + prefix;
+  size_t stride = Rec::SIZE - prefix;
+  for ( size_t i = 0; i < n; i++ ) {
+    memcpy( payload + i * stride, recs + i * Rec::SIZE + prefix, stride );
+  }
+  size_t plen = n * stride;
+
+#ifdef HAVE_LZ4_H
+  if ( COMPRESS and plen > 0 ) {
+    int c = LZ4_compress_default( (const char *) payload, (char *) scratch_,
+      plen, scratchLen_ );
+    if ( c > 0 and size_t( c ) < plen ) {
+      memcpy( payload, scratch_, c );
+      out[sizeof( n ) + 1] |= LZ4;
+      plen = c;
+    }
+  }
+#endif
+
+  return HDRSIZE + prefix + plen;
+}
+
+size_t BlockCodec::start( const uint8_t * in, size_t len )
+{
+  if ( len < HDRSIZE ) {
+    throw runtime_error( "Truncated encoded block" );
+  }
+  uint32_t n;
+  memcpy( &n, in, sizeof( n ) );
+  size_t prefix = in[sizeof( n )];
+  uint8_t flags = in[sizeof( n ) + 1];
+  if ( prefix > Rec::KEY_LEN or size_t( n ) * Rec::SIZE > blockSize_
+      or len < HDRSIZE + prefix ) {
+    throw runtime_error( "Bad encoded block" );
+  }
+
+  key_ = in + HDRSIZE;
+  prefix_ = prefix;
+  payload_ = key_ + prefix;
+  size_t plen = n * ( Rec::SIZE - prefix );
+  size_t elen = len - HDRSIZE - prefix;
+  if ( flags & LZ4 ) {
+#ifdef HAVE_LZ4_H
+    int d = LZ4_decompress_safe( (const char *) payload_, (char *) scratch_,
+      elen, scratchLen_ );
+    if ( d < 0 or size_t( d ) != plen ) {
+      throw runtime_error( "Bad compressed block" );
+    }
+    payload_ = scratch_;
+#else
+    throw runtime_error( "Compressed block, but built without LZ4" );
+#endif
+  } else if ( elen != plen ) {
+    throw runtime_error( "Bad encoded block length" );
+  }
+
+  left_ = n;
+  return size_t( n ) * Rec::SIZE;
+}
+
+size_t BlockCodec::next( uint8_t * out, size_t len )
+{
+  size_t n = min( left_, len / Rec::SIZE );
+  size_t stride = Rec::SIZE - prefix_;
+  for ( size_t i = 0; i < n; i++ ) {
+    memcpy( out + i * Rec::SIZE, key_, prefix_ );
+    memcpy( out + i * Rec::SIZE + prefix_, payload_ + i * stride, stride );
+  }
+  payload_ += n * stride;
+  left_ -= n;
+  return n * Rec::SIZE;
+}
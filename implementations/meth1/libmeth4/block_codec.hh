@@ -0,0 +1,80 @@
+#ifndef METH4_BLOCK_CODEC_HH
+#define METH4_BLOCK_CODEC_HH
+
+#include <cstddef>
+#include <cstdint>
+
+#include "config.h"
+
+#include "record.hh"
+
+#include "meth4_knobs.hh"
+
+/* Wire encoding of the blocks phase one sends between nodes. A block holds
+ * records of a single bucket, and buckets range-partition the key space, so
+ * the records share a leading run of key bytes (longer the more buckets
+ * there are). We send that prefix once per block rather than per record, and
+ * (if built with LZ4) compress the rest of the records when that pays off.
+ *
+ * Encoded block: <uint32_t records, uint8_t prefix length, uint8_t flags,
+ *                 prefix, records x (key suffix, value)>
+ * with the records compressed as a whole if flagged.
+ *
+ * Buffers (the codec's compression scratch, and the wire buffers of those
+ * using it) come from the block pool, so count against its limit. */
+class BlockCodec
+{
+public:
+  static constexpr bool ENABLED = Knobs4::NET_ENCODE_BLOCKS;
+#ifdef HAVE_LZ4_H
+  static constexpr bool COMPRESS = Knobs4::NET_COMPRESS_BLOCKS;
+#else
+  static constexpr bool COMPRESS = false;
+#endif
+
+  static constexpr size_t HDRSIZE = sizeof( uint32_t ) + 2;
+  static constexpr uint8_t LZ4 = 0x1;
+
+  /* Pool buffers held by a codec and a wire buffer for it */
+  static constexpr size_t POOL_BUFFERS = ENABLED ? ( COMPRESS ? 2 : 1 ) : 0;
+
+  /* Largest encoding of a block of len bytes */
+  static constexpr size_t maxEncoded( size_t len )
+  {
+    return HDRSIZE + Rec::KEY_LEN + len;
+  }
+
+private:
+  size_t blockSize_;
+  uint8_t * scratch_;
+  size_t scratchLen_;
+
+  /* Block being decoded: its shared key prefix, and the records (suffixes)
+   * left to decode */
+  const uint8_t * key_;
+  size_t prefix_;
+  const uint8_t * payload_;
+  size_t left_;
+
+public:
+  /* For blocks of up to blockSize bytes */
+  BlockCodec( size_t blockSize );
+  BlockCodec( BlockCodec && other );
+  BlockCodec( const BlockCodec & ) = delete;
+  BlockCodec & operator=( const BlockCodec & ) = delete;
+  ~BlockCodec( void );
+
+  /* Encode a block of records into out (of at least maxEncoded( len )),
+   * returning the encoded length */
+  size_t encode( const uint8_t * recs, size_t len, uint8_t * out );
+
+  /* Start decoding an encoded block (which must stay put until decoded),
+   * returning its decoded length */
+  size_t start( const uint8_t * in, size_t len );
+
+  /* Decode the next of the started block's records that fit in len bytes
+   * into out, returning the length decoded (0 once all are) */
+  size_t next( uint8_t * out, size_t len );
+};
+
+#endif /* METH4_BLOCK_CODEC_HH */
@@ -0,0 +1,111 @@
+#include "bucket_queue.hh"
+
+using namespace std;
+
+BucketQueue::BucketQueue( size_t disks )
+  : mtx_{}
+  , added_{}
+  , queues_( disks )
+  , open_( disks, true )
+{}
+
+void BucketQueue::push( size_t disk, uint16_t bkt )
+{
+  {
+    unique_lock<mutex> lck( mtx_ );
+    queues_[disk].push_back( bkt );
+  }
+  added_.notify_all();
+}
+
+void BucketQueue::close( size_t disk )
+{
+  {
+    unique_lock<mutex> lck( mtx_ );
+    open_[disk] = false;
+  }
+  added_.notify_all();
+}
+
+bool BucketQueue::next( size_t disk, uint16_t & bkt )
+{
+  unique_lock<mutex> lck( mtx_ );
+  added_.wait( lck, [this, disk]() {
+    return not queues_[disk].empty() or not open_[disk];
+  } );
+  if ( queues_[disk].empty() ) {
+    return false;
+  }
+  bkt = queues_[disk].front();
+  queues_[disk].pop_front();
+  return true;
+}
+
+bool BucketQueue::tryNext( size_t disk, uint16_t & bkt )
+{
+  unique_lock<mutex> lck( mtx_ );
+  if ( queues_[disk].empty() ) {
+    return false;
+  }
+  bkt = queues_[disk].front();
+  queues_[disk].pop_front();
+  return true;
+}
+
+deque<uint16_t> * BucketQueue::stealQueue( size_t minQueued,
+                                           function<bool( uint16_t )> & ok )
+{
+  deque<uint16_t> * longest = nullptr;
+  for ( auto & q : queues_ ) {
+    if ( longest == nullptr or q.size() > longest->size() ) {
+      longest = &q;
+    }
+  }
+  if ( longest == nullptr or longest->size() < minQueued
+      or longest->size() == 0 or not ok( longest->back() ) ) {
+    return nullptr;
+  }
+  return longest;
+}
+
+bool BucketQueue::steal( size_t minQueued, function<bool( uint16_t )> ok,
+                         uint16_t & bkt )
+{
+  unique_lock<mutex> lck( mtx_ );
+  deque<uint16_t> * q = stealQueue( minQueued, ok );
+  if ( q == nullptr ) {
+    return false;
+  }
+  bkt = q->back();
+  q->pop_back();
+  return true;
+}
+
+size_t BucketQueue::stealable( size_t minQueued,
+                               function<bool( uint16_t )> ok )
+{
+  unique_lock<mutex> lck( mtx_ );
+  deque<uint16_t> * q = stealQueue( minQueued, ok );
+  return q == nullptr ? 0 : q->size();
+}
+
+size_t BucketQueue::queued( void )
+{
+  unique_lock<mutex> lck( mtx_ );
+  size_t n = 0;
+  for ( auto & q : queues_ ) {
+    n += q.size();
+  }
+  return n;
+}
+
+bool BucketQueue::open( void )
+{
+  unique_lock<mutex> lck( mtx_ );
+  for ( auto o : open_ ) {
+    if ( o ) {
+      return true;
+    }
+  }
+  return false;
+}
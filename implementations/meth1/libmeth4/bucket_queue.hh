@@ -0,0 +1,59 @@
+#ifndef METH4_BUCKET_QUEUE_HH
+#define METH4_BUCKET_QUEUE_HH
+
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <vector>
+
+/* Buckets waiting to be sorted, a queue per disk. Each disk's sorter takes
+ * buckets from the front of its queue, while other nodes that have run out of
+ * their own buckets steal from the back of the longest queue. */
+class BucketQueue
+{
+private:
+  std::mutex mtx_;
+  std::condition_variable added_;
+  std::vector<std::deque<uint16_t>> queues_;
+  std::vector<uint8_t> open_;
+
+  /* The longest queue, if steal could take from it (caller holds mtx_) */
+  std::deque<uint16_t> * stealQueue( size_t minQueued,
+    std::function<bool( uint16_t )> & ok );
+
+public:
+  BucketQueue( size_t disks );
+  BucketQueue( const BucketQueue & ) = delete;
+  BucketQueue & operator=( const BucketQueue & ) = delete;
+
+  /* Queue a bucket for sorting */
+  void push( size_t disk, uint16_t bkt );
+
+  /* No more buckets will be queued for a disk */
+  void close( size_t disk );
+
+  /* Take the next bucket for a disk, waiting for one if the queue is empty
+   * but still open. Returns false once the queue is closed and empty. */
+  bool next( size_t disk, uint16_t & bkt );
+
+  /* Take the next bucket for a disk only if one is queued now */
+  bool tryNext( size_t disk, uint16_t & bkt );
+
+  /* Take the last bucket of the longest queue for another node to sort, if
+   * that queue holds at least minQueued and the bucket is ok to give away */
+  bool steal( size_t minQueued, std::function<bool( uint16_t )> ok,
+    uint16_t & bkt );
+
+  /* Buckets steal could take now, if any: the length of the longest queue */
+  size_t stealable( size_t minQueued, std::function<bool( uint16_t )> ok );
+
+  /* Buckets queued but not yet taken */
+  size_t queued( void );
+
+  /* Are buckets still being added to any queue? */
+  bool open( void );
+};
+
+#endif /* METH4_BUCKET_QUEUE_HH */
@@ -0,0 +1,113 @@
+#include <cstdlib>
+#include <cstring>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "file.hh"
+#include "util.hh"
+
+#include "bucket_store.hh"
+#include "buffer_pool.hh"
+#include "meth4_knobs.hh"
+
+using namespace std;
+
+BucketStore::BucketStore( const ClusterMap & cluster, uint64_t budget,
+                          size_t blockSize )
+  : cluster_{cluster}
+  , blockSize_{blockSize}
+  , free_{budget}
+  , blocks_( cluster.myBuckets().size() )
+  , sizes_( cluster.myBuckets().size(), 0 )
+  , resident_( cluster.myBuckets().size(), budget > 0 )
+{}
+
+BucketStore::~BucketStore( void )
+{
+  for ( auto & bkt : blocks_ ) {
+    for ( auto & b : bkt ) {
+      freeBlock( b.buf );
+    }
+  }
+}
+
+uint64_t BucketStore::budget( void )
+{
+  uint64_t mem = memory_exists();
+  if ( mem <= Knobs4::MEM_RESERVE ) {
+    return 0;
+  }
+  return ( mem - Knobs4::MEM_RESERVE ) * Knobs4::BUCKET_RETAIN_SHARE;
+}
+
+bool BucketStore::reserve( uint64_t len )
+{
+  uint64_t avail = free_.load();
+  while ( avail >= len ) {
+    if ( free_.compare_exchange_weak( avail, avail - len ) ) {
+      return true;
+    }
+  }
+  return false;
+}
+
+bool BucketStore::resident( uint16_t bkt ) const noexcept
+{
+  return resident_[cluster_.bucket_local_id( bkt )];
+}
+
+uint64_t BucketStore::size( uint16_t bkt ) const noexcept
+{
+  return sizes_[cluster_.bucket_local_id( bkt )];
+}
+
+bool BucketStore::retain( block_t block )
+{
+  size_t id = cluster_.bucket_local_id( block.bucket );
+  if ( not resident_[id] ) {
+    return false;
+  } else if ( not reserve( blockSize_ ) ) {
+    resident_[id] = false;
+    return false;
+  }
+  blocks_[id].push_back( block );
+  sizes_[id] += block.len;
+  return true;
+}
+
+vector<block_t> BucketStore::spill( uint16_t bkt )
+{
+  size_t id = cluster_.bucket_local_id( bkt );
+  resident_[id] = false;
+  sizes_[id] = 0;
+  free_ += blocks_[id].size() * blockSize_;
+  vector<block_t> held;
+  held.swap( blocks_[id] );
+  return held;
+}
+
+void BucketStore::take( uint16_t bkt, char * buf )
+{
+  size_t id = cluster_.bucket_local_id( bkt );
+  for ( auto & b : blocks_[id] ) {
+    memcpy( buf, b.buf, b.len );
+    buf += b.len;
+    freeBlock( b.buf );
+    free_ += blockSize_;
+  }
+  blocks_[id] = {};
+  sizes_[id] = 0;
+  resident_[id] = false;
+}
+
+void BucketStore::writeOut( uint16_t bkt )
+{
+  File out( cluster_.bucket_path( bkt ), O_WRONLY | O_CREAT | O_TRUNC,
+    S_IRUSR | S_IWUSR );
+  for ( auto & b : spill( bkt ) ) {
+    out.write_all( (char *) b.buf, b.len );
+    freeBlock( b.buf );
+  }
+  out.fsync();
+}
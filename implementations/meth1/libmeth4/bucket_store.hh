@@ -0,0 +1,65 @@
+#ifndef METH4_BUCKET_STORE_HH
+#define METH4_BUCKET_STORE_HH
+
+#include <atomic>
+#include <vector>
+
+#include "block.hh"
+#include "cluster_map.hh"
+
+/* Holds received buckets in memory, rather than writing them to disk for
+ * phase two to read back, for as long as they fit in a memory budget. A bucket
+ * that overflows the budget spills to disk (keeping its earlier blocks in
+ * order) and stays on disk.
+ *
+ * Each bucket is only ever touched by one thread at a time (its disk writer,
+ * then its sorter), so only the budget is shared. */
+class BucketStore
+{
+private:
+  const ClusterMap & cluster_;
+  size_t blockSize_;
+  std::atomic<uint64_t> free_;
+  std::vector<std::vector<block_t>> blocks_; // by local bucket ID
+  std::vector<uint64_t> sizes_;              // by local bucket ID
+  std::vector<uint8_t> resident_;            // by local bucket ID
+
+  /* Reserve memory from the budget */
+  bool reserve( uint64_t len );
+
+public:
+  /* Blocks held are allocated `blockSize` long, which is what they count
+   * against the budget. */
+  BucketStore( const ClusterMap & cluster, uint64_t budget,
+    size_t blockSize );
+  BucketStore( const BucketStore & ) = delete;
+  BucketStore & operator=( const BucketStore & ) = delete;
+  ~BucketStore( void );
+
+  /* Is the bucket (still) held in memory? */
+  bool resident( uint16_t bkt ) const noexcept;
+
+  /* Number of bytes held for a resident bucket */
+  uint64_t size( uint16_t bkt ) const noexcept;
+
+  /* Hold a block (taking ownership) if its bucket is resident and there is
+   * room, otherwise the bucket is no longer resident and false is returned. */
+  bool retain( block_t block );
+
+  /* Give up the blocks held for a bucket that can no longer be resident, in
+   * the order received. The caller owns (and must free) the blocks. */
+  std::vector<block_t> spill( uint16_t bkt );
+
+  /* Copy a resident bucket out into a buffer of at least size() bytes,
+   * freeing the blocks held for it (so it's no longer resident). */
+  void take( uint16_t bkt, char * buf );
+
+  /* Write a resident bucket out to its bucket file, as phase one would have
+   * without us, freeing the blocks held for it. */
+  void writeOut( uint16_t bkt );
+
+  /* Memory budget for holding buckets on this machine */
+  static uint64_t budget( void );
+};
+
+#endif /* METH4_BUCKET_STORE_HH */
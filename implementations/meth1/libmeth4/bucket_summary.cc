@@ -0,0 +1,153 @@
+#include <zlib.h>
+
+#include <cstring>
+#include <iostream>
+
+#include "exception.hh"
+#include "file.hh"
+
+#include "bucket_summary.hh"
+
+using namespace std;
+
+void BucketSummary::u16_t::add( u16_t x ) noexcept
+{
+  uint64_t lo = lo8 + x.lo8;
+  hi8 += x.hi8 + ( lo < lo8 ? 1 : 0 );
+  lo8 = lo;
+}
+
+/* Long division of the 32-bit words by 10^9 (so each step fits in 64 bits),
+ * nine digits at a time */
+string BucketSummary::u16_t::to_dec( void ) const
+{
+  static constexpr uint64_t BASE = 1000000000;
+  uint64_t w[4] = {hi8 >> 32, hi8 & 0xffffffff, lo8 >> 32, lo8 & 0xffffffff};
+  string s;
+  bool more;
+  do {
+    uint64_t r = 0;
+    more = false;
+    for ( auto & x : w ) {
+      x += r << 32;
+      r = x % BASE;
+      x /= BASE;
+      more = more or x != 0;
+    }
+    string digits = to_string( r );
+    if ( more ) {
+      digits.insert( 0, 9 - digits.size(), '0' );
+    }
+    s.insert( 0, digits );
+  } while ( more );
+  return s;
+}
+
+string BucketSummary::u16_t::to_hex( void ) const
+{
+  char buf[33];
+  if ( hi8 != 0 ) {
+    snprintf( buf, sizeof( buf ), "%lx%016lx", (unsigned long) hi8,
+      (unsigned long) lo8 );
+  } else {
+    snprintf( buf, sizeof( buf ), "%lx", (unsigned long) lo8 );
+  }
+  return buf;
+}
+
+BucketSummary::BucketSummary( void )
+  : firstUnordered_{0, 0}
+  , unordered_{0, 0}
+  , records_{0, 0}
+  , dups_{0, 0}
+  , checksum_{0, 0}
+{
+  memset( first_, 0, sizeof( first_ ) );
+  memset( last_, 0, sizeof( last_ ) );
+}
+
+void BucketSummary::add( const uint8_t * recs, uint64_t len )
+{
+  if ( len % Rec::SIZE != 0 ) {
+    throw runtime_error( "Summarizing a partial record" );
+  }
+
+  for ( const uint8_t * r = recs; r < recs + len; r += Rec::SIZE ) {
+    checksum_.add( {0, crc32( 0, r, Rec::SIZE )} );
+    if ( records_.zero() ) {
+      memcpy( first_, r, Rec::SIZE );
+    } else {
+      int cmp = memcmp( last_, r, Rec::KEY_LEN );
+      if ( cmp == 0 ) {
+        dups_.add( {0, 1} );
+      } else if ( cmp > 0 ) {
+        if ( firstUnordered_.zero() ) {
+          firstUnordered_ = records_;
+        }
+        unordered_.add( {0, 1} );
+      }
+    }
+    records_.add( {0, 1} );
+    memcpy( last_, r, Rec::SIZE );
+  }
+}
+
+void BucketSummary::combine( const BucketSummary & next )
+{
+  if ( next.records_.zero() ) {
+    return;
+  } else if ( records_.zero() ) {
+    *this = next;
+    return;
+  }
+
+  // the boundary between the two, as valsort's sum_summaries
+  int cmp = memcmp( last_, next.first_, Rec::KEY_LEN );
+  if ( cmp == 0 ) {
+    dups_.add( {0, 1} );
+  } else if ( cmp > 0 ) {
+    if ( firstUnordered_.zero() ) {
+      firstUnordered_ = records_;
+    }
+    unordered_.add( {0, 1} );
+  }
+  if ( firstUnordered_.zero() and not next.firstUnordered_.zero() ) {
+    firstUnordered_ = records_;
+    firstUnordered_.add( next.firstUnordered_ );
+  }
+
+  unordered_.add( next.unordered_ );
+  records_.add( next.records_ );
+  dups_.add( next.dups_ );
+  checksum_.add( next.checksum_ );
+  memcpy( last_, next.last_, Rec::SIZE );
+}
+
+void BucketSummary::save( string path ) const
+{
+  File out( path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR );
+  out.write_all( (const char *) this, sizeof( *this ) );
+}
+
+BucketSummary BucketSummary::load( string path )
+{
+  BucketSummary sum;
+  File in( path, O_RDONLY );
+  if ( in.read_all( (char *) &sum, sizeof( sum ) ) != sizeof( sum ) ) {
+    throw runtime_error( "Truncated bucket summary: " + path );
+  }
+  return sum;
+}
+
+void BucketSummary::print( ostream & out ) const
+{
+  out << "Records: " << records_.to_dec() << endl;
+  out << "Checksum: " << checksum_.to_hex() << endl;
+  if ( not ordered() ) {
+    out << "ERROR - there are " << unordered_.to_dec()
+        << " unordered records" << endl;
+  } else {
+    out << "Duplicate keys: " << dups_.to_dec() << endl;
+    out << "SUCCESS - all records are in order" << endl;
+  }
+}
@@ -0,0 +1,59 @@
+#ifndef METH4_BUCKET_SUMMARY_HH
+#define METH4_BUCKET_SUMMARY_HH
+
+#include <cstdint>
+#include <string>
+
+#include "record.hh"
+
+/* A valsort (gensort package) partition summary of a sorted bucket, computed
+ * as the bucket is saved so validating a run doesn't need to read the sorted
+ * data back. Laid out as valsort's `struct summary`, so a file of summaries
+ * (in bucket order) can also be checked with `valsort -s`. */
+class BucketSummary
+{
+public:
+  /* valsort's 128-bit unsigned integer */
+  struct u16_t
+  {
+    uint64_t hi8;
+    uint64_t lo8;
+
+    void add( u16_t x ) noexcept;
+    bool zero( void ) const noexcept { return hi8 == 0 and lo8 == 0; }
+    std::string to_dec( void ) const;
+    std::string to_hex( void ) const;
+  };
+
+private:
+  u16_t firstUnordered_; // index of first unordered record (or 0 if none)
+  u16_t unordered_;
+  u16_t records_;
+  u16_t dups_;
+  u16_t checksum_;       // sum of each record's crc32
+  uint8_t first_[Rec::SIZE];
+  uint8_t last_[Rec::SIZE];
+
+public:
+  BucketSummary( void );
+
+  /* Add the next records of the bucket (in sorted order) */
+  void add( const uint8_t * recs, uint64_t len );
+
+  /* Append the summary of the following bucket (or partition) */
+  void combine( const BucketSummary & next );
+
+  uint64_t records( void ) const noexcept { return records_.lo8; }
+  bool ordered( void ) const noexcept { return unordered_.zero(); }
+
+  void save( std::string path ) const;
+  static BucketSummary load( std::string path );
+
+  /* Print in the same format as valsort */
+  void print( std::ostream & out ) const;
+};
+
+static_assert( sizeof( BucketSummary ) == 16 * 5 + 2 * Rec::SIZE,
+  "BucketSummary not laid out as valsort's summary" );
+
+#endif /* METH4_BUCKET_SUMMARY_HH */
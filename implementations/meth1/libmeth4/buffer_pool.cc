@@ -0,0 +1,171 @@
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+#include "exception.hh"
+#include "io_device.hh"
+
+#include "block_codec.hh"
+#include "buffer_pool.hh"
+
+using namespace std;
+
+BufferPool::BufferPool( void )
+  : mtx_{}
+  , returned_{}
+  , free_{}
+  , out_{}
+  , limit_{numeric_limits<size_t>::max()}
+  , count_{0}
+  , pooling_{true}
+{}
+
+BufferPool::~BufferPool( void )
+{
+  retire();
+}
+
+void BufferPool::limit( size_t n )
+{
+  unique_lock<mutex> lck( mtx_ );
+  limit_ = max( n, size_t( 1 ) );
+  returned_.notify_all();
+}
+
+uint8_t * BufferPool::get( size_t len )
+{
+  unique_lock<mutex> lck( mtx_ );
+  while ( true ) {
+    // best fit from the pool
+    size_t best = free_.size();
+    for ( size_t i = free_.size(); i-- > 0; ) {
+      if ( free_[i].second >= len
+           and ( best == free_.size() or free_[i].second < free_[best].second ) ) {
+        best = i;
+        if ( free_[i].second == len ) {
+          break;
+        }
+      }
+    }
+    if ( best != free_.size() ) {
+      auto b = free_[best];
+      free_[best] = free_.back();
+      free_.pop_back();
+      out_[b.first] = b.second;
+      return b.first;
+    }
+
+    // else replace a pooled buffer that's too small, or add a new one
+    if ( count_ >= limit_ and not free_.empty() ) {
+      free( free_.back().first );
+      free_.pop_back();
+      count_--;
+    }
+    if ( count_ < limit_ ) {
+      break;
+    }
+    returned_.wait( lck );
+  }
+  count_++;
+  lck.unlock();
+
+  // allocate and fault in outside the lock
+  uint8_t * buf = nullptr;
+  SystemCall( "posix_memalign", posix_memalign( (void **) &buf,
+    IODevice::ODIRECT_ALIGN, len ) );
+  memset( buf, 0, len );
+
+  lck.lock();
+  out_[buf] = len;
+  return buf;
+}
+
+void BufferPool::put( uint8_t * buf )
+{
+  if ( buf == nullptr ) {
+    return;
+  }
+
+  unique_lock<mutex> lck( mtx_ );
+  auto it = out_.find( buf );
+  if ( it == out_.end() ) {
+    throw runtime_error( "Buffer not from pool" );
+  }
+  if ( pooling_ ) {
+    free_.push_back( *it );
+  } else {
+    free( buf );
+    count_--;
+  }
+  out_.erase( it );
+  returned_.notify_one();
+}
+
+size_t BufferPool::trim( void )
+{
+  unique_lock<mutex> lck( mtx_ );
+  size_t bytes = 0;
+  for ( auto & b : free_ ) {
+    free( b.first );
+    bytes += b.second;
+  }
+  count_ -= free_.size();
+  free_.clear();
+  returned_.notify_all();
+  return bytes;
+}
+
+void BufferPool::retire( void )
+{
+  trim();
+  unique_lock<mutex> lck( mtx_ );
+  pooling_ = false;
+}
+
+BufferPool & blockPool( void )
+{
+  static BufferPool pool;
+  return pool;
+}
+
+uint8_t * newBlock( void )
+{
+  return blockPool().get( POOL_BLOCK_SIZE );
+}
+
+void freeBlock( uint8_t * buf )
+{
+  blockPool().put( buf );
+}
+
+BufferPool & bucketPool( void )
+{
+  static BufferPool pool;
+  return pool;
+}
+
+// Blocks phase one may have at once: each sender holds a block per cluster
+// bucket (and one more in hand); the network queues, and a block in flight per
+// stream, sending and receiving; the receiver holds a block per node bucket;
+// and each disk writer has its queue, a block in hand, and a partial block per
+// node bucket. Plus any retained in memory for phase two, and the codec
+// buffers of each stream's sender and receiver.
+size_t blockPoolLimit( ClusterMap & cluster, uint64_t retained )
+{
+  size_t streams = cluster.nodes() * Knobs4::NET_STREAMS_PER_NODE;
+  size_t nodeBkts = cluster.myBuckets().size();
+  size_t writers = cluster.disk_paths().size();
+
+  return cluster.files().size() * ( cluster.buckets() + 1 )
+    + Knobs4::NET_QUEUE_LENGTH + 3 * streams
+    + nodeBkts
+    + writers * ( Knobs4::DISK_W_QUEUE_LENGTH + 1 ) + nodeBkts
+    + retained / POOL_BLOCK_SIZE
+    + 2 * streams * BlockCodec::POOL_BUFFERS;
+}
+
+// Phase two sorts a bucket per disk while loading the next
+size_t bucketPoolLimit( const ClusterMap & cluster )
+{
+  return 2 * cluster.disks();
+}
@@ -0,0 +1,70 @@
+#ifndef METH4_BUFFER_POOL_HH
+#define METH4_BUFFER_POOL_HH
+
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "record.hh"
+
+#include "cluster_map.hh"
+#include "meth4_knobs.hh"
+
+/* A pool of buffers (aligned for O_DIRECT) that are recycled rather than freed,
+ * so we only page fault their memory in once. New buffers are pre-faulted as
+ * they're allocated. At most `limit` buffers exist at once, with get() waiting
+ * for one to be returned when at the limit. Returned buffers are reused for any
+ * request they're big enough for, else replaced with a bigger buffer. */
+class BufferPool
+{
+private:
+  std::mutex mtx_;
+  std::condition_variable returned_;
+  std::vector<std::pair<uint8_t *, size_t>> free_;
+  std::unordered_map<uint8_t *, size_t> out_;
+  size_t limit_;
+  size_t count_;
+  bool pooling_;
+
+public:
+  BufferPool( void );
+  BufferPool( const BufferPool & ) = delete;
+  BufferPool & operator=( const BufferPool & ) = delete;
+  ~BufferPool( void );
+
+  /* Limit the number of buffers that can exist at once */
+  void limit( size_t n );
+
+  /* Check out a buffer at least len bytes long */
+  uint8_t * get( size_t len );
+
+  /* Return a buffer to the pool (ignoring null buffers, like free) */
+  void put( uint8_t * buf );
+
+  /* Free the pooled buffers (not those checked out), while still pooling any
+   * returned after, for when the buffers won't be needed for a while. Returns
+   * the bytes freed. */
+  size_t trim( void );
+
+  /* Free all pooled buffers and stop pooling any returned after, for once the
+   * buffers are no longer needed (but some may still be checked out). */
+  void retire( void );
+};
+
+/* Pool of phase one network and disk blocks */
+static constexpr size_t POOL_BLOCK_SIZE = Knobs4::NET_BLOCK_SIZE * Rec::SIZE;
+BufferPool & blockPool( void );
+uint8_t * newBlock( void );
+void freeBlock( uint8_t * buf );
+
+/* Pool of phase two bucket buffers */
+BufferPool & bucketPool( void );
+
+/* Pool limits for the memory budget (see meth4_knobs.hh), with the number of
+ * bytes phase one may retain in memory for phase two. */
+size_t blockPoolLimit( ClusterMap & cluster, uint64_t retained );
+size_t bucketPoolLimit( const ClusterMap & cluster );
+
+#endif /* METH4_BUFFER_POOL_HH */
@@ -64,8 +64,11 @@ size_t calcMaxSortSize( size_t disks )
   // By 2 since we want to overlap reading in one bucket while sorting the
   // previous one.
   // FIXME: Two should be configurable, but requires changing sort.hh as well.
+  // Sorting through a key index (see sort.hh) also takes a 12 byte KeyIndex
+  // per record, and as much again for the radix sort's scratch copy.
+  size_t perRec = Rec::SIZE + ( Knobs4::SORT_KEY_INDEX ? 2 * 12 : 0 );
   size_t mem = memory_exists() - Knobs4::MEM_RESERVE;
-  return ( mem / Rec::SIZE ) / disks / 2;
+  return ( mem / perRec ) / disks / 2;
 }
 
 size_t bucketsPerNode( size_t recordsPerNode, size_t disksPerNode )
@@ -145,6 +148,9 @@ const vector<std::string> & ClusterMap::disk_paths( void ) const noexcept
 const string BUCKET_DIR = "buckets";
 const string BUCKET_EXT = ".bucket";
 const string BUCKET_SORTED = "sorted.";
+const string BUCKET_RUN = "run.";
+const string BUCKET_SUMMARY = "summary.";
+const string SUMMARY_EXT = ".valsum";
 
 string ClusterMap::disk_bucket_directory( size_t diskID ) const noexcept
 {
@@ -164,6 +170,20 @@ string ClusterMap::sorted_bucket_path( uint16_t bkt ) const noexcept
     + to_string(bkt) + BUCKET_EXT;
 }
 
+string ClusterMap::bucket_summary_path( uint16_t bkt ) const noexcept
+{
+  size_t diskID = bucket_disk( bkt );
+  return disk_bucket_directory( diskID ) + "/" + BUCKET_SUMMARY
+    + to_string(bkt) + SUMMARY_EXT;
+}
+
+string ClusterMap::bucket_run_path( uint16_t bkt, size_t run ) const noexcept
+{
+  size_t diskID = bucket_disk( bkt );
+  return disk_bucket_directory( diskID ) + "/" + BUCKET_RUN
+    + to_string(bkt) + "." + to_string(run) + BUCKET_EXT;
+}
+
 size_t ClusterMap::disks( void ) const noexcept
 {
   return disks_;
@@ -195,6 +215,11 @@ size_t ClusterMap::bucketMaxSize( void ) const noexcept
   return bucketMaxSize_ * Rec::SIZE;
 }
 
+void ClusterMap::bucketMaxSize( size_t records ) noexcept
+{
+  bucketMaxSize_ = records;
+}
+
 using uint128_t = __uint128_t;
 
 uint128_t maxKey( void ) noexcept
@@ -88,6 +88,12 @@ public:
   /* Path to bucket once sorted. */
   std::string sorted_bucket_path( uint16_t bkt ) const noexcept;
 
+  /* Path to the (valsort) summary of a sorted bucket. */
+  std::string bucket_summary_path( uint16_t bkt ) const noexcept;
+
+  /* Path to a sorted run of a bucket too big to sort in memory. */
+  std::string bucket_run_path( uint16_t bkt, size_t run ) const noexcept;
+
   /* Number of local disks available. */
   size_t disks( void ) const noexcept;
 
@@ -106,9 +112,13 @@ public:
   /* Map a key to a bucket. */
   uint16_t bucket( const uint8_t * key ) const noexcept;
 
-  /* Maximum bucket size in bytes. */
+  /* Maximum bucket size in bytes (that we can sort in memory). */
   size_t bucketMaxSize( void ) const noexcept;
 
+  /* Override the maximum bucket size (in records), e.g. to test sorting
+   * buckets too big for memory. */
+  void bucketMaxSize( size_t records ) noexcept;
+
   /* Number of items in a buckets (only for buckets stored locally) */
   uint64_t bucketSize( uint16_t bkt ) const noexcept;
   uint64_t & bucketSize( uint16_t bkt );
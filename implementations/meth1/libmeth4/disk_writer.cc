@@ -1,6 +1,9 @@
 #include <sys/stat.h>
 #include <sys/types.h>
 
+#include <cstring>
+
+#include "buffer_pool.hh"
 #include "disk_writer.hh"
 #include "sync_print.hh"
 
@@ -9,18 +12,18 @@ using namespace std;
 const string BUCKET_DIR = "buckets";
 const string BUCKET_EXT = "bucket";
 
-// De-allocation helper
-static void freeBlock( uint8_t * buf )
-{
-  free( buf );
-}
-
-DiskWriter::DiskWriter( ClusterMap & cluster, uint8_t diskID, string diskPath )
+DiskWriter::DiskWriter( ClusterMap & cluster, BucketStore & store,
+                        uint8_t diskID, string diskPath )
   : cluster_{cluster}
+  , store_{store}
   , diskID_{diskID}
   , diskPath_{diskPath}
   , files_{}
+  , written_{}
+  , partial_{}
+  , open_{}
   , queue_{DISK_QUEUE_LENGTH}
+  , closed_{}
   , writer_{}
   , threadStarted_{false}
   , start_{}
@@ -37,18 +40,30 @@ DiskWriter::DiskWriter( ClusterMap & cluster, uint8_t diskID, string diskPath )
       }
       // FIXME: Should we keep the buckets open for phase two?
       files_.emplace_back( cluster_.bucket_path( bkt ), O_WRONLY | O_CREAT | O_TRUNC,
-                           S_IRUSR | S_IWUSR );
+                           S_IRUSR | S_IWUSR,
+                           DISK_DIRECT ? File::DIRECT : File::CACHED );
     }
   }
+  written_.resize( files_.size(), 0 );
+  partial_.resize( files_.size() );
+  open_.resize( files_.size(), true );
+
+  // big enough to never block the writer
+  closed_ = Channel<uint16_t>( max( files_.size(), size_t( 1 ) ) );
   print( "disk", (size_t) diskID_, diskPath, files_.size() );
 }
 
 DiskWriter::DiskWriter( DiskWriter && other )
   : cluster_{other.cluster_}
+  , store_{other.store_}
   , diskID_{other.diskID_}
   , diskPath_{other.diskPath_}
   , files_{move( other.files_ )}
+  , written_{move( other.written_ )}
+  , partial_{move( other.partial_ )}
+  , open_{move( other.open_ )}
   , queue_{move( other.queue_ )}
+  , closed_{move( other.closed_ )}
   , writer_{move( other.writer_ )}
   , threadStarted_{other.threadStarted_}
   , start_{other.start_}
@@ -69,9 +84,13 @@ void DiskWriter::start( void )
 
 DiskWriter::~DiskWriter( void )
 {
-  waitDrained( true );
+  // writer closes all buckets on exit, so fsync after
+  queue_.waitEmpty();
   queue_.close();
   if ( writer_.joinable() ) { writer_.join(); }
+  for ( auto & f : files_ ) {
+    f.fsync();
+  }
   print( "p1", "disk-end", timestamp<ms>(), time_diff<ms>( start_ ) );
 }
 
@@ -100,6 +119,104 @@ void DiskWriter::send( block_t block )
   queue_.send( block );
 }
 
+/* Write a block out to a bucket file */
+void DiskWriter::writeOut( uint16_t fileID, block_t & block )
+{
+  files_[fileID].write_all( (char *) block.buf, block.len );
+  if ( not DISK_DIRECT ) {
+    // TODO: Should we be fsync'ing here?
+    files_[fileID].fsync();
+  }
+  written_[fileID] += block.len;
+  freeBlock( block.buf );
+  block.buf = nullptr;
+  block.len = 0;
+}
+
+/* Write out any blocks held in memory for a bucket that no longer fits. These
+ * are all full blocks as only the last block of a bucket may be partial. */
+void DiskWriter::spillBucket( uint16_t fileID, uint16_t bucket )
+{
+  for ( auto & b : store_.spill( bucket ) ) {
+    writeOut( fileID, b );
+  }
+}
+
+/* Hold a full block in memory if the bucket is resident, else write it */
+void DiskWriter::writeBlock( uint16_t fileID, block_t & block )
+{
+  if ( store_.retain( block ) ) {
+    block.buf = nullptr;
+    block.len = 0;
+  } else {
+    spillBucket( fileID, block.bucket );
+    writeOut( fileID, block );
+  }
+}
+
+/* Combine a partial block with any held for the bucket. We fill the held
+ * block from the new one, writing it once full and holding whatever is left
+ * of the new one instead. So we only copy data from partial blocks, and only
+ * ever write whole (O_DIRECT aligned) blocks until the bucket is closed. */
+void DiskWriter::combineBlock( uint16_t fileID, block_t & block )
+{
+  block_t & held = partial_[fileID];
+  if ( held.buf == nullptr ) {
+    held = block;
+    return;
+  }
+
+  size_t n = min( BLOCK_SIZE - held.len, block.len );
+  memcpy( held.buf + held.len, block.buf, n );
+  held.len += n;
+
+  if ( held.len == BLOCK_SIZE ) {
+    writeBlock( fileID, held );
+    if ( n < block.len ) {
+      memmove( block.buf, block.buf + n, block.len - n );
+      block.len -= n;
+      held = block;
+    } else {
+      freeBlock( block.buf );
+    }
+  } else {
+    freeBlock( block.buf );
+  }
+}
+
+/* Write out any partial block held for the bucket (unless the whole bucket is
+ * staying in memory). With O_DIRECT we pad the write to the alignment and then
+ * truncate the padding off the file. */
+void DiskWriter::closeBucket( uint16_t fileID, uint16_t bucket )
+{
+  if ( not open_[fileID] ) {
+    return;
+  }
+  open_[fileID] = false;
+
+  block_t & held = partial_[fileID];
+  if ( held.buf != nullptr and store_.retain( held ) ) {
+    held.buf = nullptr;
+    held.len = 0;
+  } else if ( held.buf != nullptr ) {
+    spillBucket( fileID, bucket );
+    size_t len = held.len;
+    if ( DISK_DIRECT and len % IODevice::ODIRECT_ALIGN != 0 ) {
+      size_t pad = IODevice::ODIRECT_ALIGN - len % IODevice::ODIRECT_ALIGN;
+      memset( held.buf + len, 0, pad );
+      held.len += pad;
+    }
+    uint64_t fsize = written_[fileID] + len;
+    writeOut( fileID, held );
+    if ( written_[fileID] != fsize ) {
+      files_[fileID].truncate( fsize );
+      written_[fileID] = fsize;
+    }
+  }
+
+  closed_.send( bucket );
+}
+
 /* Read from channel and write data to disk */
 void DiskWriter::writeLoop( void )
 {
@@ -111,17 +228,35 @@ void DiskWriter::writeLoop( void )
       uint16_t fileID = diskLocalBucketID( block.bucket );
       if ( fileID >= files_.size() ) {
         throw runtime_error( "fileID is not valid" );
+      } else if ( block.buf == nullptr ) {
+        auto t0 = time_now();
+        closeBucket( fileID, block.bucket );
+        twrite += time_diff<ms>( t0 );
       } else if ( block.len > 0 ) {
+        // only this writer handles the bucket, so can count it unsynchronized
+        cluster_.bucketSize( block.bucket ) += block.len / Rec::SIZE;
         auto t0 = time_now();
-        files_[fileID].write_all( (char *) block.buf, block.len );
-        // TODO: Should we be fsync'ing here?
-        files_[fileID].fsync();
+        if ( block.len == BLOCK_SIZE ) {
+          writeBlock( fileID, block );
+        } else {
+          combineBlock( fileID, block );
+        }
         twrite += time_diff<ms>( t0 );
+      } else {
+        freeBlock( block.buf );
       }
-      freeBlock( block.buf );
     }
   } catch ( const Channel<block_t>::closed_error & e ) {
     // EOF
   }
+
+  auto t1 = time_now();
+  for ( auto bkt : cluster_.myBuckets() ) {
+    if ( cluster_.bucket_disk( bkt ) == diskID_ ) {
+      closeBucket( diskLocalBucketID( bkt ), bkt );
+    }
+  }
+  twrite += time_diff<ms>( t1 );
+
   print( "p1", "disk-write", timestamp<ms>(), time_diff<ms>( t0 ), twrite );
 }
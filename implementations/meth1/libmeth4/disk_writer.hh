@@ -10,18 +10,31 @@
 #include "timestamp.hh"
 
 #include "block.hh"
+#include "bucket_store.hh"
 #include "cluster_map.hh"
 
 class DiskWriter
 {
+public:
+  static constexpr bool DISK_DIRECT = Knobs4::DISK_W_DIRECT;
+  static constexpr size_t BLOCK_SIZE = Knobs4::DISK_W_BLOCK_SIZE * Rec::SIZE;
+
+  static_assert( BLOCK_SIZE % IODevice::ODIRECT_ALIGN == 0,
+    "DISK_W_BLOCK_SIZE not a multiple of the O_DIRECT alignment" );
+
 private:
   static constexpr size_t DISK_QUEUE_LENGTH = Knobs4::DISK_W_QUEUE_LENGTH;
 
   ClusterMap & cluster_;
+  BucketStore & store_;
   uint8_t diskID_;
   std::string diskPath_;
   std::vector<File> files_;
+  std::vector<uint64_t> written_;
+  std::vector<block_t> partial_;
+  std::vector<uint8_t> open_;
   Channel<block_t> queue_;
+  Channel<uint16_t> closed_;
   std::thread writer_;
   bool threadStarted_;
   tpoint_t start_;
@@ -29,11 +42,28 @@ private:
   /* Convert a global bucket ID to a disk local bucket ID */
   uint16_t diskLocalBucketID( uint16_t bucket );
 
+  /* Write a block out to a bucket file */
+  void writeOut( uint16_t fileID, block_t & block );
+
+  /* Write out any blocks held in memory for a bucket that no longer fits */
+  void spillBucket( uint16_t fileID, uint16_t bucket );
+
+  /* Hold a full block in memory if the bucket is resident, else write it */
+  void writeBlock( uint16_t fileID, block_t & block );
+
+  /* Combine a partial block with any held for the bucket */
+  void combineBlock( uint16_t fileID, block_t & block );
+
+  /* Write out any partial block held for the bucket, padding as needed, and
+   * announce the bucket as complete */
+  void closeBucket( uint16_t fileID, uint16_t bucket );
+
   /* Read from channel and write data to disk */
   void writeLoop( void );
 
 public:
-  DiskWriter( ClusterMap & cluster, uint8_t diskID, std::string diskPath );
+  DiskWriter( ClusterMap & cluster, BucketStore & store, uint8_t diskID,
+    std::string diskPath );
 
   /* Disable copy */
   DiskWriter( const DiskWriter & ) = delete;
@@ -48,9 +78,16 @@ public:
   /* Start the writing thread */
   void start( void );
 
-  /* Queue a block to be written to disk */
+  /* Queue a block to be written to disk (or held in memory while the bucket
+   * fits in the store). Blocks must be allocated BLOCK_SIZE long and aligned
+   * for O_DIRECT. Full blocks are written immediately, partial ones are
+   * combined until the bucket is closed. A block with no buffer closes the
+   * bucket, else all close with the writer. */
   void send( block_t block );
 
+  /* Channel of (global) IDs of buckets once closed */
+  Channel<uint16_t> closedBuckets( void ) const noexcept { return closed_; }
+
   /* Wait until disk writer has drained the current queue */
   void waitDrained( bool fsync = false );
 };
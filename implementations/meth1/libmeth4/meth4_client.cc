@@ -1,10 +1,17 @@
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <cstdlib>
+#include <iostream>
 #include <memory>
 #include <thread>
 #include <vector>
 
 #include "address.hh"
 #include "exception.hh"
+#include "file.hh"
 #include "socket.hh"
 #include "sync_print.hh"
 #include "timestamp.hh"
@@ -15,34 +22,127 @@
 
 using namespace std;
 
-void runNode( TCPSocket node, size_t i )
+Meth4Client::Meth4Client( string port, size_t backends, string out )
+  : mode_{out.empty() ? DISCARD : ( out == "-" ? STREAM_OUT : FILE_OUT )}
+  , nodes_{}
+  , tables_( backends )
+  , out_{}
+  , size_{0}
+  , mtx_{}
+  , turn_{}
+  , next_{0}
+{
+  if ( mode_ == FILE_OUT ) {
+    out_.reset( new File( out, O_WRONLY | O_CREAT | O_TRUNC,
+      S_IRUSR | S_IWUSR ) );
+  } else if ( mode_ == STREAM_OUT ) {
+    // keep our logging out of the stream
+    cout.rdbuf( cerr.rdbuf() );
+    out_.reset( new FileDescriptor( STDOUT_FILENO ) );
+  }
+
+  TCPSocket sock{IPV4};
+  sock.set_reuseaddr();
+  sock.set_nodelay();
+  sock.set_send_buffer( Knobs4::NET_SND_BUF );
+  sock.set_recv_buffer( Knobs4::NET_RCV_BUF );
+  sock.bind( { "0.0.0.0", port } );
+  sock.listen( max( backends, size_t( 16 ) ) );
+
+  // wait for all backends to connect
+  for ( size_t i = 0; i < backends; i++ ) {
+    nodes_.push_back( sock.accept() );
+  }
+}
+
+void Meth4Client::receiveTables( void )
+{
+  constexpr size_t HDRSIZE = sizeof( uint16_t ) + sizeof( uint64_t );
+
+  vector<bucket_t *> order;
+  for ( size_t i = 0; i < nodes_.size(); i++ ) {
+    uint64_t n;
+    if ( nodes_[i].read_all( (char *) &n, sizeof( n ) ) != sizeof( n ) ) {
+      throw runtime_error( "Backend closed before sending bucket table" );
+    }
+    string hdrs = nodes_[i].read_all( n * HDRSIZE );
+    if ( hdrs.size() != n * HDRSIZE ) {
+      throw runtime_error( "Backend closed while sending bucket table" );
+    }
+
+    const char * data = hdrs.data();
+    for ( size_t j = 0; j < n; j++, data += HDRSIZE ) {
+      uint16_t id = *reinterpret_cast<const uint16_t *>( data );
+      uint64_t len = *reinterpret_cast<const uint64_t *>( data + 2 );
+      if ( j > 0 and id <= tables_[i].back().id ) {
+        throw runtime_error( "Backend not sending buckets in key order" );
+      }
+      tables_[i].push_back( {id, len, 0} );
+    }
+    for ( auto & b : tables_[i] ) {
+      order.push_back( &b );
+    }
+  }
+
+  // buckets are numbered in key order
+  sort( order.begin(), order.end(), []( bucket_t * a, bucket_t * b ) {
+    return a->id < b->id;
+  } );
+  for ( auto b : order ) {
+    b->offset = size_;
+    size_ += b->len;
+  }
+  print( "client-buckets", timestamp<ms>(), order.size(), size_ );
+}
+
+void Meth4Client::receiveBuckets( size_t i )
 {
   constexpr size_t bufSize = 1024 * 1024 * 2;
-  unique_ptr<char> buf( new char[bufSize] );
+  unique_ptr<char[]> buf( new char[bufSize] );
+  TCPSocket & node = nodes_[i];
 
   auto t0 = time_now();
   print( "client-start", timestamp<ms>(), i );
+  for ( auto & b : tables_[i] ) {
+    if ( mode_ == STREAM_OUT ) {
+      // wait for all buckets before this one to be streamed out
+      unique_lock<mutex> lck( mtx_ );
+      turn_.wait( lck, [this, &b]() { return next_ == b.offset; } );
+    }
+
+    for ( uint64_t n = 0; n < b.len; ) {
+      size_t r = node.read( buf.get(), min( bufSize, size_t( b.len - n ) ) );
+      if ( r == 0 and node.eof() ) {
+        throw runtime_error( "Backend closed while sending bucket" );
+      }
+      if ( mode_ == FILE_OUT ) {
+        out_->pwrite_all( buf.get(), r, b.offset + n );
+      } else if ( mode_ == STREAM_OUT ) {
+        out_->write_all( buf.get(), r );
+      }
+      n += r;
+    }
+
+    if ( mode_ == STREAM_OUT ) {
+      unique_lock<mutex> lck( mtx_ );
+      next_ += b.len;
+      turn_.notify_all();
+    }
+  }
+
   while ( not node.eof() ) {
     node.read( buf.get(), bufSize );
   }
   print( "client-end", timestamp<ms>(), i, time_diff<ms>( t0 ) );
 }
 
-void run( string port, string backends )
+void Meth4Client::run( void )
 {
-  TCPSocket sock{IPV4};
-  sock.set_reuseaddr();
-  sock.set_nodelay();
-  sock.set_send_buffer( Knobs4::NET_SND_BUF );
-  sock.set_recv_buffer( Knobs4::NET_RCV_BUF );
-  sock.bind( { "0.0.0.0", port } );
-  sock.listen();
+  receiveTables();
 
-  // wait for all backends to connect
   vector<thread> nodes;
-  size_t n = atoll( backends.c_str() );
-  for ( size_t i = 0; i < n; i++ ) {
-    nodes.emplace_back( runNode, sock.accept(), i );
+  for ( size_t i = 0; i < nodes_.size(); i++ ) {
+    nodes.emplace_back( &Meth4Client::receiveBuckets, this, i );
   }
 
   // wait for them to finish
@@ -51,11 +151,17 @@ void run( string port, string backends )
   }
 }
 
+void run( string port, string backends, string out )
+{
+  Meth4Client client( port, atoll( backends.c_str() ), out );
+  client.run();
+}
+
 void check_usage( const int argc, const char * const argv[] )
 {
   if ( argc < 3 ) {
     throw runtime_error( "Usage: " + string( argv[0] )
-      + " [port] [backends*disks]" );
+      + " [port] [backends*disks] [output file | - (stdout)]" );
   }
 }
 
@@ -63,7 +169,7 @@ int main( int argc, char * argv[] )
 {
   try {
     check_usage( argc, argv );
-    run( argv[1], argv[2] );
+    run( argv[1], argv[2], argc > 3 ? argv[3] : "" );
   } catch ( const exception & e ) {
     print_exception( e );
     return EXIT_FAILURE;
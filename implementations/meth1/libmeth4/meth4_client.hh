@@ -1,5 +1,62 @@
 #ifndef METH4_CLIENT_HH
 #define METH4_CLIENT_HH
 
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include "file_descriptor.hh"
+#include "socket.hh"
+
+/* Receives the sorted buckets from every backend disk and assembles them into
+ * the final sorted output.
+ *
+ * Each backend connection first sends a table of the buckets it'll send, as a
+ * count followed by a <uint16 bucket, uint64 len> header per bucket, and then
+ * the buckets themselves in that (ascending) order. Global bucket IDs are in
+ * key order, so once we have every table we know where each bucket goes.
+ *
+ * The output is either written to a file, each bucket written at its final
+ * offset as it arrives from any backend, or streamed in key order (e.g., to
+ * stdout for a consumer), in which case backends take turns. */
+class Meth4Client
+{
+public:
+  enum output_t { DISCARD, FILE_OUT, STREAM_OUT };
+
+private:
+  /* Bucket as placed in the output */
+  struct bucket_t {
+    uint16_t id;
+    uint64_t len;
+    uint64_t offset;
+  };
+
+  output_t mode_;
+  std::vector<TCPSocket> nodes_;
+  std::vector<std::vector<bucket_t>> tables_; // by connection
+  std::unique_ptr<FileDescriptor> out_;
+  uint64_t size_;
+
+  /* Next offset to stream out (STREAM_OUT) */
+  std::mutex mtx_;
+  std::condition_variable turn_;
+  uint64_t next_;
+
+  /* Read each backends bucket table and place the buckets */
+  void receiveTables( void );
+
+  /* Receive all buckets from one backend */
+  void receiveBuckets( size_t i );
+
+public:
+  /* Output is a file path, '-' for streaming to stdout, or empty to discard */
+  Meth4Client( std::string port, size_t backends, std::string out );
+
+  /* Receive and assemble all buckets */
+  void run( void );
+};
 
 #endif /* METH4_CLIENT_HH */
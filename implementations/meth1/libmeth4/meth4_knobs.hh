@@ -11,17 +11,21 @@
 /*
  * Queue Lengths:
  * A) (QL + 2) x #Disks.
- * B) (QL + 1 ) x #Disks + #NodeBuckets.
- * C) QL + 1 + #ClusterBuckets x #Disks.
+ * B) (QL + 1 ) x #Disks + 2 x #NodeBuckets.
+ * C) QL + #Nodes x #Streams + #ClusterBuckets x #Disks.
  *
  * Buffer Sizes (now):
  * A) 2GB x #Disks.
- * B) 2GB x #Disks + #NodeBuckets x 10MB.
+ * B) 2GB x #Disks + #NodeBuckets x 20MB.
  * C) 4GB + #ClusterBuckets x #Disks x 1MB.
  *
  * Total Size (now):
  * T = A + B + C
- * T = 4GB + #NodeBuckets x 10MB + #Disks x ( 4GB + #ClusterBuckets x 1MB )
+ * T = 4GB + #NodeBuckets x 20MB + #Disks x ( 4GB + #ClusterBuckets x 1MB )
+ *
+ * The B + C blocks (plus any retained for phase two) come from a block pool
+ * limited to that many, and phase two's bucket buffers from a pool limited to
+ * two per disk (see buffer_pool.hh).
  */
 
 namespace Knobs4 {
@@ -32,25 +36,83 @@ namespace Knobs4 {
   static constexpr size_t DISK_W_QUEUE_LENGTH = 200; // ~ 2000MB
   static constexpr size_t DISK_W_BLOCK_SIZE = 1024 * 102; // ~ 10MB
 
+  /* Write buckets with O_DIRECT? Only full blocks are written until a bucket
+   * is closed, with a partial block per bucket held in memory till then. */
+  static constexpr bool DISK_W_DIRECT = true;
+
   /* C. Network queue length & block transfer size [* Rec::SIZE] */
   static constexpr size_t NET_QUEUE_LENGTH = 2000; // ~ 4000MB
   static constexpr size_t NET_BLOCK_SIZE = 1024 * 102; // ~ 10MB
 
+  /* Phase-one partitioning: records staged and classified per batch, and
+   * records held in each bucket's cache-resident write-combining buffer before
+   * being flushed to the bucket's network block. */
+  static constexpr size_t PART_BATCH_RECS = 1024; // ~ 100KB
+  static constexpr size_t PART_WC_RECS = 8; // ~ 800B
+
+  /* Outbound TCP streams to open to each node, each with its own queue and
+   * sending thread. A node's buckets are spread across its streams. */
+  static constexpr size_t NET_STREAMS_PER_NODE = 1;
+
   /* Network send & receive kernel buffer sizes */
   static constexpr size_t NET_SND_BUF = size_t( 1024 ) * 1024 * 2;
   static constexpr size_t NET_RCV_BUF = size_t( 1024 ) * 1024 * 2;
 
+  /* Encode phase one blocks sent between nodes, sending the key prefix a
+   * block's records share once, and (if built with LZ4) compressing the rest
+   * when it's smaller? Costs CPU on both ends and a block pool buffer or two
+   * per stream each way, so is only worth it when the shuffle is
+   * network-bound. */
+  static constexpr bool NET_ENCODE_BLOCKS = false;
+  static constexpr bool NET_COMPRESS_BLOCKS = false;
+
   /* Use non-blocking IO on the phase-1 receive side? */
   static constexpr bool NET_NON_BLOCKING = true;
 
+  /* Sort each bucket as soon as phase one completes it, overlapping the two
+   * phases (for operations that touch every bucket)? This needs memory to
+   * sort one bucket per disk on top of the phase one buffers. */
+  static constexpr bool OVERLAP_PHASES = true;
+
+  /* Let nodes that finish sorting their own buckets take unsorted buckets
+   * from nodes still sorting (for operations that keep their output on the
+   * nodes)? A node is only taken from while it has at least the minimum
+   * queued, and busy nodes are polled for their progress at the interval. */
+  static constexpr bool STEAL_BUCKETS = true;
+  static constexpr size_t STEAL_MIN_QUEUED = 2;
+  static constexpr size_t STEAL_POLL_MS = 100;
+
+  /* Share of memory (after MEM_RESERVE) to keep received buckets in, rather
+   * than writing them to disk for phase two to read back. Buckets that don't
+   * fit spill to disk, and those kept are sorted first. Zero disables. */
+  static constexpr double BUCKET_RETAIN_SHARE = 0.25;
+
+  /* Sort buckets through a compact (8-byte key prefix, index) array rather
+   * than moving whole records, permuting them as they're written out. Costs
+   * ~24 bytes of memory per record while sorting. */
+  static constexpr bool SORT_KEY_INDEX = true;
+
+  /* Write a valsort summary (record count, checksum, duplicates, first and
+   * last keys) of each bucket as it's saved, so a run can be validated by
+   * combining them (see meth4_valsum) rather than re-reading the output. */
+  static constexpr bool SORT_SUMMARIES = true;
+
+  /* Most records a READ_RANGE replies with, however many are asked for;
+   * callers page through larger ranges. */
+  static constexpr uint64_t RANGE_MAX_RECORDS = 1024 * 1024; // 100MB
+
   /* Minimum number of buckets to have per disk */
   static constexpr size_t MIN_BUCKETS_PER_DISK = 2;
 
   /* Memory to leave unused for OS and other misc purposes. */
   static constexpr uint64_t MEM_RESERVE = uint64_t( 1024 ) * 1024 * 1024 * 2;
 
-  /* Seconds to wait after startup before trying to connect to other nodes */
-  static constexpr size_t STARTUP_WAIT = 10;
+  /* Connecting to other nodes is retried (as they may not be listening yet),
+   * backing off exponentially between attempts from the initial to the max
+   * delay, giving up after the timeout. */
+  static constexpr size_t CONNECT_BACKOFF_MS = 10;
+  static constexpr size_t CONNECT_BACKOFF_MAX_MS = 1000;
+  static constexpr size_t CONNECT_TIMEOUT = 120;
 }
 
 #endif /* METH4_KNOBS_HH */
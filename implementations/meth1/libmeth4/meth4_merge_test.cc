@@ -0,0 +1,104 @@
+/**
+ * External sort of a bucket too big to sort in memory: the bucket (a copy of
+ * the given file, either on disk or held resident in the bucket store) is
+ * sorted in runs of the given number of records at most, which are then
+ * merged. The sorted bucket must hold exactly the records given, in key order.
+ */
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+#include <fcntl.h>
+#include <sys/stat.h>
+
+#include "exception.hh"
+#include "file.hh"
+
+#include "bucket_store.hh"
+#include "buffer_pool.hh"
+#include "cluster_map.hh"
+#include "disk_writer.hh"
+#include "sort.hh"
+
+using namespace std;
+
+static string readFile( string path )
+{
+  File in( path, O_RDONLY );
+  string data( in.size(), 0 );
+  if ( in.read_all( &data[0], data.size() ) != data.size() ) {
+    throw runtime_error( "Short read of " + path );
+  }
+  return data;
+}
+
+// The records of a file, in an order that doesn't depend on the file's
+static vector<string> records( const string & data )
+{
+  vector<string> recs;
+  for ( size_t i = 0; i < data.size(); i += Rec::SIZE ) {
+    recs.push_back( data.substr( i, Rec::SIZE ) );
+  }
+  sort( recs.begin(), recs.end() );
+  return recs;
+}
+
+void run( string conf, string file, size_t maxRecords, bool resident )
+{
+  ClusterMap c( 0, conf, {file} );
+  c.bucketMaxSize( maxRecords );
+  string in = readFile( file );
+  size_t nblocks = in.size() / DiskWriter::BLOCK_SIZE + 1;
+  BucketStore s( c, resident ? nblocks * DiskWriter::BLOCK_SIZE : 0,
+    DiskWriter::BLOCK_SIZE );
+  uint16_t bkt = c.myBuckets()[0];
+
+  if ( resident ) {
+    for ( size_t i = 0; i < in.size(); i += DiskWriter::BLOCK_SIZE ) {
+      size_t len = min( DiskWriter::BLOCK_SIZE, in.size() - i );
+      block_t b( newBlock(), len, bkt );
+      memcpy( b.buf, &in[i], len );
+      if ( not s.retain( b ) ) {
+        throw runtime_error( "Bucket store full" );
+      }
+    }
+  } else {
+    File b( c.bucket_path( bkt ), O_WRONLY | O_CREAT | O_TRUNC,
+      S_IRUSR | S_IWUSR );
+    b.write_all( in.data(), in.size() );
+  }
+
+  BucketSorter bs( c, s, bkt );
+  bs.loadBucket();
+  bs.sortBucket();
+  bs.saveBucket();
+  bs.freeBucket();
+
+  string out = readFile( c.sorted_bucket_path( bkt ) );
+  for ( size_t i = Rec::SIZE; i < out.size(); i += Rec::SIZE ) {
+    if ( memcmp( &out[i - Rec::SIZE], &out[i], Rec::KEY_LEN ) > 0 ) {
+      throw runtime_error( "Out of order at " + to_string( i / Rec::SIZE ) );
+    }
+  }
+  if ( records( out ) != records( in ) ) {
+    throw runtime_error( "Sorted bucket doesn't hold the records given" );
+  }
+  cout << "merge-ok, " << out.size() / Rec::SIZE << endl;
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc != 4 and ( argc != 5 or string( argv[4] ) != "resident" ) ) {
+      throw runtime_error( "Usage: " + string( argv[0] )
+        + " [conf] [file] [max records in memory] (resident)" );
+    }
+    run( argv[1], argv[2], stoul( argv[3] ), argc == 5 );
+  } catch ( const exception & e ) {
+    print_exception( e );
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -10,6 +10,8 @@
 #include "timestamp.hh"
 #include "util.hh"
 
+#include "bucket_store.hh"
+#include "buffer_pool.hh"
 #include "cluster_map.hh"
 #include "config_file.hh"
 #include "meth4_knobs.hh"
@@ -17,6 +19,7 @@
 #include "recv.hh"
 #include "send.hh"
 #include "sort.hh"
+#include "steal.hh"
 
 using namespace std;
 
@@ -54,19 +57,28 @@ void debug_cluster_map( ClusterMap & cluster )
 }
 
 // Do in seperate block as we want destructors to run to free memory after
-// phase one is complete.
-void phase_one( ClusterMap & cluster, string port )
+// phase one is complete. If the operation allows, starts sorting buckets as
+// they're completed, returning the (still running) sorter.
+void phase_one( ClusterMap & cluster, BucketStore & store, string port,
+                string op, unique_ptr<StreamSorter> & sorter )
 {
   // startup cluster
-  Receiver receiver( cluster, {"0.0.0.0", port} );
-
-  // wait short while for server socket to come up
-  this_thread::sleep_for( chrono::seconds( Knobs4::STARTUP_WAIT ) );
+  Receiver receiver( cluster, store, {"0.0.0.0", port} );
+
+  // sort buckets as they complete
+  if ( Knobs4::OVERLAP_PHASES and StreamSorter::canOverlap( op ) ) {
+    print( "phase-two-overlap", timestamp<ms>() );
+    vector<Channel<uint16_t>> closed;
+    for ( size_t i = 0; i < cluster.disks(); i++ ) {
+      closed.push_back( receiver.closedBuckets( i ) );
+    }
+    sorter.reset( new StreamSorter( cluster, store, op, closed ) );
+  }
 
-  // establish outbound connections (separate thread)
-  NetOut net( cluster );
+  // establish outbound connections (retrying until each node is listening)
+  NetOut net( cluster, receiver );
 
-  // establish inbound connections
+  // establish inbound connections, waiting for the whole cluster to connect
   receiver.waitForConnections();
 
   // transfer data to correct nodes
@@ -78,9 +90,35 @@ void phase_one( ClusterMap & cluster, string port )
   receiver.receiveLoop();
 }
 
-void phase_two( ClusterMap & cluster, string op, string arg1 )
+// Wait for our own buckets to be sorted, then (if the operation allows) help
+// the nodes still sorting theirs. We serve other nodes taking our buckets (on
+// the port phase one used) until they're all done.
+template<typename S>
+void finish_sorting( ClusterMap & cluster, BucketStore & store, string port,
+                     string op, S & sorter )
 {
-  Sorter sorter( cluster, op, arg1 );
+  if ( not Knobs4::STEAL_BUCKETS or not BucketStealer::canSteal( op ) ) {
+    sorter.waitFinished();
+    return;
+  }
+  BucketStealer stealer( cluster, store, sorter.queue(), {"0.0.0.0", port} );
+  sorter.waitFinished();
+  stealer.stealBuckets();
+}
+
+void phase_two( ClusterMap & cluster, BucketStore & store, string port,
+                string op, string arg1 )
+{
+  if ( op == "lazy" ) {
+    // only sort buckets as queries touch them, serving queries (on the port
+    // phase one used) until told to exit
+    LazySorter sorter( cluster, store );
+    NodeRCP rpc( cluster, sorter, {"0.0.0.0", port} );
+    rpc.notifyReady();
+  } else {
+    Sorter sorter( cluster, store, op, arg1 );
+    finish_sorting( cluster, store, port, op, sorter );
+  }
 }
 
 void run( size_t nodeID, string port, string conffile, string op, string arg1,
@@ -93,21 +131,38 @@ void run( size_t nodeID, string port, string conffile, string op, string arg1,
   debug_cluster_map( cluster );
   print( "operation", op, arg1 );
 
+  // buckets kept in memory between the phases
+  uint64_t retain = BucketStore::budget();
+  print( "retain-memory", retain );
+  BucketStore store( cluster, retain, DiskWriter::BLOCK_SIZE );
+
+  // bound the buffers each phase may use
+  blockPool().limit( blockPoolLimit( cluster, retain ) );
+  bucketPool().limit( bucketPoolLimit( cluster ) );
+  print( "pool-limits", blockPoolLimit( cluster, retain ),
+    bucketPoolLimit( cluster ) );
+
   // shard data into buckets
   auto t0 = time_now();
   print( "phase-one-start", timestamp<ms>() );
-  phase_one( cluster, port );
-  print( "phase-one-end", timestamp<ms>(),
-    time_diff<ms>( t0 ) - Knobs4::STARTUP_WAIT * 1000 );
+  unique_ptr<StreamSorter> sorter;
+  phase_one( cluster, store, port, op, sorter );
+  print( "phase-one-end", timestamp<ms>(), time_diff<ms>( t0 ) );
 
-  // sort each bucket
+  // free pooled blocks for phase two (retained ones are freed as they're used)
+  blockPool().retire();
+
+  // sort each bucket (or finish sorting them if overlapped with phase one)
   auto t1 = time_now();
   print( "phase-two-start", timestamp<ms>() );
-  phase_two( cluster, op, arg1 );
+  if ( sorter ) {
+    finish_sorting( cluster, store, port, op, *sorter );
+  } else {
+    phase_two( cluster, store, port, op, arg1 );
+  }
   print( "phase-two-end", timestamp<ms>(), time_diff<ms>( t1 ) );
 
-  print( "finish", timestamp<ms>(),
-    time_diff<ms>( t0 ) - Knobs4::STARTUP_WAIT * 1000 );
+  print( "finish", timestamp<ms>(), time_diff<ms>( t0 ) );
 
   // give chance for other nodes to finish before exit (useful while testing)
   this_thread::sleep_for( chrono::seconds( 2 ) );
@@ -0,0 +1,60 @@
+/**
+ * Bucket stealing between two nodes, where one has only buckets that can't be
+ * stolen (one queued on each of two disks, so no queue holds the minimum).
+ * Both must finish without taking anything, and shut down.
+ */
+#include <iostream>
+#include <thread>
+
+#include "exception.hh"
+
+#include "bucket_queue.hh"
+#include "bucket_store.hh"
+#include "cluster_map.hh"
+#include "disk_writer.hh"
+#include "steal.hh"
+
+using namespace std;
+
+void run( string conf, string file0, string file1 )
+{
+  ClusterMap c0( 0, conf, {file0} ), c1( 1, conf, {file1} );
+  BucketStore s0( c0, 0, DiskWriter::BLOCK_SIZE );
+  BucketStore s1( c1, 0, DiskWriter::BLOCK_SIZE );
+
+  BucketQueue q0( 1 ), q1( 2 );
+  q0.close( 0 );
+  q1.push( 0, c1.myBuckets()[0] );
+  q1.push( 1, c1.myBuckets()[1] );
+  q1.close( 0 );
+  q1.close( 1 );
+
+  size_t n0 = 0, n1 = 0;
+  {
+    BucketStealer b0( c0, s0, q0, c0.addresses()[0] );
+    BucketStealer b1( c1, s1, q1, c1.addresses()[1] );
+    thread t1( [&b1, &n1]() { n1 = b1.stealBuckets(); } );
+    n0 = b0.stealBuckets();
+    t1.join();
+  }
+
+  if ( n0 != 0 or n1 != 0 or q1.queued() != 2 ) {
+    throw runtime_error( "Stole unstealable buckets" );
+  }
+  cout << "steal-ok" << endl;
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    if ( argc != 4 ) {
+      throw runtime_error( "Usage: " + string( argv[0] )
+        + " [conf] [file0] [file1]" );
+    }
+    run( argv[1], argv[2], argv[3] );
+  } catch ( const exception & e ) {
+    print_exception( e );
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,80 @@
+#include <algorithm>
+#include <cstdlib>
+#include <iostream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "exception.hh"
+
+#include "bucket_summary.hh"
+
+using namespace std;
+
+// Combines the per-bucket summaries meth4 nodes write as they save sorted
+// buckets into a single valsort result for the whole run, without reading any
+// of the sorted data.
+
+// Bucket ID from a summary path ("<dir>/summary.<bkt>.valsum")
+uint64_t summaryBucket( const string & path )
+{
+  size_t ext = path.rfind( '.' );
+  size_t dot = path.rfind( '.', ext - 1 );
+  if ( ext == string::npos or dot == string::npos or dot + 1 >= ext ) {
+    throw runtime_error( "Not a bucket summary: " + path );
+  }
+  return stoull( path.substr( dot + 1, ext - dot - 1 ) );
+}
+
+int run( vector<string> paths, string out )
+{
+  // summaries must be combined in bucket (so key) order
+  vector<pair<uint64_t, string>> bkts;
+  for ( auto & p : paths ) {
+    bkts.emplace_back( summaryBucket( p ), p );
+  }
+  sort( bkts.begin(), bkts.end() );
+
+  BucketSummary all;
+  for ( auto & b : bkts ) {
+    all.combine( BucketSummary::load( b.second ) );
+  }
+
+  if ( all.records() == 0 ) {
+    throw runtime_error( "There must be at least one record to validate" );
+  }
+  if ( not out.empty() ) {
+    all.save( out );
+  }
+  all.print( cerr );
+
+  return all.ordered() ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+void check_usage( const int argc, const char * const argv[] )
+{
+  if ( argc < 2 ) {
+    throw runtime_error( "Usage: " + string( argv[0] )
+      + " [-o summary file] [bucket summaries...]" );
+  }
+}
+
+int main( int argc, char * argv[] )
+{
+  try {
+    check_usage( argc, argv );
+    string out;
+    int first = 1;
+    if ( string( argv[1] ) == "-o" ) {
+      if ( argc < 4 ) {
+        check_usage( 1, argv );
+      }
+      out = argv[2];
+      first = 3;
+    }
+    return run( {argv + first, argv + argc}, out );
+  } catch ( const exception & e ) {
+    print_exception( e );
+    return EXIT_FAILURE;
+  }
+}
@@ -1,3 +1,5 @@
+#include <cstring>
+
 #include "exception.hh"
 #include "timestamp.hh"
 #include "sync_print.hh"
@@ -7,8 +9,9 @@
 
 using namespace std;
 
-NodeRCP::NodeRCP( ClusterMap & cluster, Address address )
+NodeRCP::NodeRCP( ClusterMap & cluster, LazySorter & sorter, Address address )
   : cluster_{cluster}
+  , sorter_{sorter}
   , sock_{IPV4}
   , rdy_{}
   , thread_{}
@@ -54,6 +57,12 @@ void NodeRCP::handleClient( void )
             print( "bucket-size", b, cluster_.bucketSize( b ) );
           }
           break;
+        case RPC::SORT:
+          RPC_Sort( client );
+          break;
+        case RPC::READ_RANGE:
+          RPC_ReadRange( client );
+          break;
         case RPC::EXIT:
           print( "\nexit", timestamp<ms>() );
           return;
@@ -68,3 +77,36 @@ void NodeRCP::handleClient( void )
   }
   print( "\ndirty-exit", timestamp<ms>() );
 }
+
+// Read a <uint8_t length, string> pair from the wire
+static string readString( TCPSocket & client )
+{
+  uint8_t len = client.read_all( 1 )[0];
+  return len == 0 ? "" : client.read_all( len );
+}
+
+void NodeRCP::RPC_Sort( TCPSocket & client )
+{
+  string op = readString( client );
+  string arg1 = readString( client );
+
+  uint64_t n = sorter_.query( op, arg1 );
+  client.write_all( reinterpret_cast<const char *>( &n ), sizeof( uint64_t ) );
+}
+
+void NodeRCP::RPC_ReadRange( TCPSocket & client )
+{
+  string args = client.read_all( 2 * Rec::KEY_LEN + sizeof( uint64_t ) );
+  if ( args.size() != 2 * Rec::KEY_LEN + sizeof( uint64_t ) ) {
+    throw runtime_error( "Truncated range request" );
+  }
+  const uint8_t * lo = reinterpret_cast<const uint8_t *>( args.data() );
+  const uint8_t * hi = lo + Rec::KEY_LEN;
+  uint64_t limit;
+  memcpy( &limit, args.data() + 2 * Rec::KEY_LEN, sizeof( limit ) );
+
+  string recs = sorter_.range( lo, hi, limit );
+  uint64_t n = recs.size() / Rec::SIZE;
+  client.write_all( reinterpret_cast<const char *>( &n ), sizeof( uint64_t ) );
+  client.write_all( recs );
+}
@@ -8,6 +8,7 @@
 #include "socket.hh"
 
 #include "cluster_map.hh"
+#include "sort.hh"
 
 class NodeRCP
 {
@@ -15,11 +16,13 @@ public:
   enum RPC : int8_t {
     BUCKETS,
     SORT,
-    EXIT
+    EXIT,
+    READ_RANGE
   };
 
 private:
   ClusterMap & cluster_;
+  LazySorter & sorter_;
   TCPSocket sock_;
   Channel<bool> rdy_;
   std::thread thread_;
@@ -27,8 +30,15 @@ private:
 
   void handleClient( void );
 
+  /* SORT: <uint8_t, op, uint8_t, arg1> -> <uint64_t buckets sorted> */
+  void RPC_Sort( TCPSocket & client );
+
+  /* READ_RANGE: <key lo, key hi, uint64_t limit> -> <uint64_t n, n records>,
+   * our smallest records in [lo, hi) */
+  void RPC_ReadRange( TCPSocket & client );
+
 public:
-  NodeRCP( ClusterMap & cluster, Address address );
+  NodeRCP( ClusterMap & cluster, LazySorter & sorter, Address address );
 
   NodeRCP( const NodeRCP & ) = delete;
   NodeRCP & operator=( const NodeRCP & ) = delete;
@@ -1,29 +1,21 @@
+#include <cstring>
 #include <iostream>
 
+#include "exception.hh"
 #include "sync_print.hh"
 #include "timestamp.hh"
 
+#include "buffer_pool.hh"
 #include "recv.hh"
 
 using namespace std;
 using namespace PollerShortNames;
 
-// Allocation helper
-static uint8_t * newBlock( void )
-{
-  return (uint8_t *) malloc( Receiver::DISK_BLOCK_SIZE );
-}
-
-// De-allocation helper
-static void freeBlock( uint8_t * buf )
-{
-  free( buf );
-}
-
-NetIn::NetIn( ClusterMap & cluster, vector<DiskWriter> & disks, TCPSocket sock )
+NetIn::NetIn( ClusterMap & cluster, Receiver & receiver, TCPSocket sock )
   : cluster_{cluster}
-  , disks_{disks}
-  // NetIn per-node, so myBuckets * disks EOF notifications...
+  , receiver_{receiver}
+  // NetIn per-stream, and every stream sees all EOFs, so myBuckets * disks
+  // EOF notifications...
   , bucketsLive_{cluster.myBuckets().size() * cluster.disks()}
   , sock_{move( sock )}
   , wireState_{IDLE}
@@ -32,13 +24,19 @@ NetIn::NetIn( ClusterMap & cluster, vector<DiskWriter> & disks, TCPSocket sock )
   , bucketOnWire_{0}
   , bucketLocalID_{0}
   , bodyOnWire_{0}
+  , partial_{}
+  , partialLen_{0}
+  , codec_{Receiver::DISK_BLOCK_SIZE}
+  , wire_{BlockCodec::ENABLED ? blockPool().get(
+      BlockCodec::maxEncoded( Receiver::DISK_BLOCK_SIZE ) ) : nullptr}
+  , wireLen_{0}
   , cantMove_{false}
 {
 }
 
 NetIn::NetIn( NetIn && other )
   : cluster_{other.cluster_}
-  , disks_{other.disks_}
+  , receiver_{other.receiver_}
   , bucketsLive_{other.bucketsLive_}
   , sock_{move( other.sock_ )}
   , wireState_{other.wireState_}
@@ -46,8 +44,14 @@ NetIn::NetIn( NetIn && other )
   , bucketOnWire_{other.bucketOnWire_}
   , bucketLocalID_{other.bucketLocalID_}
   , bodyOnWire_{other.bodyOnWire_}
+  , partial_{}
+  , partialLen_{other.partialLen_}
+  , codec_{move( other.codec_ )}
+  , wire_{other.wire_}
+  , wireLen_{other.wireLen_}
   , cantMove_{other.cantMove_}
 {
+  memcpy( partial_, other.partial_, partialLen_ );
   if ( other.cantMove_  ) {
     // FIXME: Hack to allow us to easily take a reference to a NetIn for
     // Polling, but at least catch when this breaks.
@@ -59,6 +63,13 @@ NetIn::NetIn( NetIn && other )
   other.wireState_ = DONE;
   other.headerOnWire_ = 0;
   other.bodyOnWire_ = 0;
+  other.partialLen_ = 0;
+  other.wire_ = nullptr;
+}
+
+NetIn::~NetIn( void )
+{
+  blockPool().put( wire_ );
 }
 
 bool NetIn::read( std::vector<block_t> & buckets )
@@ -93,7 +104,12 @@ bool NetIn::read( std::vector<block_t> & buckets )
       bucketOnWire_ = *reinterpret_cast<const uint16_t *>( rpcData );
       bodyOnWire_ = *reinterpret_cast<const uint64_t *>( rpcData + 2 );
       bucketLocalID_ = cluster_.bucket_local_id( bucketOnWire_  );
+      if ( BlockCodec::ENABLED and bodyOnWire_
+           > BlockCodec::maxEncoded( Receiver::DISK_BLOCK_SIZE ) ) {
+        throw runtime_error( "Encoded block too big" );
+      }
       if ( bodyOnWire_ == 0 ) { // EOF -- bucket
+        receiver_.deliver( {nullptr, 0, bucketOnWire_} );
         bucketsLive_--;
         if ( bucketsLive_ == 0 ) {
           wireState_ = DONE;
@@ -103,7 +119,6 @@ bool NetIn::read( std::vector<block_t> & buckets )
           continue;
         }
       }
-      cluster_.bucketSize( bucketOnWire_ ) += bodyOnWire_ / Rec::SIZE;
       wireState_ = BODY;
 
     case BODY:
@@ -114,22 +129,42 @@ bool NetIn::read( std::vector<block_t> & buckets )
       if ( block->bucket != bucketOnWire_ ) {
         throw runtime_error( "Wrong bucket selected" );
       }
-      rmax = min( Receiver::DISK_BLOCK_SIZE - block->len, bodyOnWire_ );
-      n = sock_.read( (char *) block->buf + block->len, rmax );
+      if ( BlockCodec::ENABLED ) {
+        n = sock_.read( (char *) wire_ + wireLen_, bodyOnWire_ );
+        if ( n == 0 ) {
+          return true;
+        }
+        bodyOnWire_ -= n;
+        wireLen_ += n;
+        if ( bodyOnWire_ == 0 ) {
+          appendEncoded( *block );
+          wireState_ = IDLE;
+        }
+        break;
+      }
+      // only ever append whole records to the shared block, so restore any
+      // held back partial record first and hold back a new one after
+      memcpy( block->buf + block->len, partial_, partialLen_ );
+      offset = block->len + partialLen_;
+      rmax = min( Receiver::DISK_BLOCK_SIZE - offset, bodyOnWire_ );
+      n = sock_.read( (char *) block->buf + offset, rmax );
       if ( n == 0 ) {
         return true;
       }
-      block->len += n;
       bodyOnWire_ -= n;
+      n += partialLen_;
+      partialLen_ = n % Rec::SIZE;
+      block->len += n - partialLen_;
+      memcpy( partial_, block->buf + block->len, partialLen_ );
 
-      if ( block->len == Receiver::DISK_BLOCK_SIZE or bodyOnWire_ == 0 ) {
-        DiskWriter & dw = disks_[cluster_.bucket_disk( bucketOnWire_ )];
-        dw.send( *block );
+      // only write full blocks, the rest go at the end of the receive
+      if ( block->len == Receiver::DISK_BLOCK_SIZE ) {
+        receiver_.deliver( *block );
         block->buf = newBlock();
         block->len = 0;
-        if ( bodyOnWire_ == 0 ) {
-          wireState_ = IDLE;
-        }
+      }
+      if ( bodyOnWire_ == 0 ) {
+        wireState_ = IDLE;
       }
       break;
 
@@ -144,21 +179,42 @@ bool NetIn::read( std::vector<block_t> & buckets )
   }
 }
 
-Receiver::Receiver( ClusterMap & cluster, Address address )
+void NetIn::appendEncoded( block_t & block )
+{
+  codec_.start( wire_, wireLen_ );
+  wireLen_ = 0;
+  while ( size_t n = codec_.next( block.buf + block.len,
+                                  Receiver::DISK_BLOCK_SIZE - block.len ) ) {
+    block.len += n;
+    if ( block.len == Receiver::DISK_BLOCK_SIZE ) {
+      receiver_.deliver( block );
+      block.buf = newBlock();
+      block.len = 0;
+    }
+  }
+}
+
+Receiver::Receiver( ClusterMap & cluster, BucketStore & store,
+                    Address address )
   : cluster_{cluster}
   , poll_{}
   , sock_{IPV4}
   , netins_{}
   , buckets_{cluster.myBuckets().size()}
-  , backendsLive_{cluster_.nodes()}
+  , backendsLive_{( cluster_.nodes() - 1 ) * NET_STREAMS}
   , disks_{}
+  , eofMtx_{}
+  , eofs_( buckets_.size(), 0 )
+  // an EOF per bucket from each sender (one per disk) on each node, over every
+  // stream from other nodes and directly from our own
+  , eofsExpected_{cluster_.disks() * ( backendsLive_ + 1 )}
 {
   sock_.set_reuseaddr();
   sock_.set_nodelay();
   sock_.set_send_buffer( Knobs4::NET_SND_BUF );
   sock_.set_recv_buffer( Knobs4::NET_RCV_BUF );
   sock_.bind( address );
-  sock_.listen();
+  sock_.listen( max( cluster_.nodes() * NET_STREAMS, size_t( 16 ) ) );
 
   print( "p0", "listen", sock_.local_address().to_string() );
 
@@ -170,7 +226,7 @@ Receiver::Receiver( ClusterMap & cluster, Address address )
   // be resized.
   disks_.reserve( cluster_.disk_paths().size() );
   for ( size_t i = 0; i < cluster_.disk_paths().size(); i++) {
-    disks_.emplace_back( cluster_, i, cluster_.disk_paths()[i] );
+    disks_.emplace_back( cluster_, store, i, cluster_.disk_paths()[i] );
     disks_.back().start();
   }
 }
@@ -184,19 +240,31 @@ Receiver::~Receiver( void )
 
 void Receiver::waitForConnections( void )
 {
-  for ( size_t i = 0; i < cluster_.nodes(); i++ ) {
+  // all other nodes connect to us, but not ourselves
+  for ( size_t i = 0; i < backendsLive_; i++ ) {
     TCPSocket s = sock_.accept();
     s.set_nodelay();
     s.set_send_buffer( Knobs4::NET_SND_BUF );
     s.set_recv_buffer( Knobs4::NET_RCV_BUF );
-    if ( NET_NON_BLOCKING ) {
-      s.set_non_blocking();
-    }
-    netins_.emplace_back( cluster_, disks_, move( s ) );
+    netins_.emplace_back( cluster_, *this, move( s ) );
     print( "p0", "new-connection",
       netins_.back().socket().peer_address().to_string() );
   }
 
+  // barrier: each stream's node sends one once all its streams are connected,
+  // so once we have them all every node is connected to every other
+  for ( auto & n : netins_ ) {
+    string b = n.socket().read_all( 1 );
+    if ( b.size() != 1 or b[0] != BARRIER ) {
+      throw runtime_error( "Bad barrier from "
+        + n.socket().peer_address().to_string() );
+    }
+    if ( NET_NON_BLOCKING ) {
+      n.socket().set_non_blocking();
+    }
+  }
+  print( "p0", "barrier", timestamp<ms>() );
+
   // Setup polling on all sockets
   for ( auto & n : netins_ ) {
     n.disableMove();
@@ -216,6 +284,40 @@ void Receiver::waitForConnections( void )
   }
 }
 
+void Receiver::deliver( block_t block )
+{
+  if ( block.buf == nullptr ) {
+    bucketEOF( block.bucket );
+  } else {
+    disks_[cluster_.bucket_disk( block.bucket )].send( block );
+  }
+}
+
+void Receiver::bucketEOF( uint16_t bkt )
+{
+  unique_lock<mutex> lck( eofMtx_ );
+  size_t id = cluster_.bucket_local_id( bkt );
+  if ( ++eofs_[id] == eofsExpected_ ) {
+    // no more data for the bucket can arrive, so safe to take its block here
+    // even if not the receive thread
+    DiskWriter & dw = disks_[cluster_.bucket_disk( bkt )];
+    block_t & b = buckets_[id];
+    if ( b.len > 0 ) {
+      dw.send( b );
+    } else {
+      freeBlock( b.buf );
+    }
+    b.buf = nullptr;
+    b.len = 0;
+    dw.send( {nullptr, 0, bkt} ); // close
+  }
+}
+
+Channel<uint16_t> Receiver::closedBuckets( size_t diskID )
+{
+  return disks_[diskID].closedBuckets();
+}
+
 void Receiver::receiveLoop( void )
 {
   auto t0 = time_now();
@@ -1,6 +1,7 @@
 #ifndef METH4_RECV_HH
 #define METH4_RECV_HH
 
+#include <mutex>
 #include <vector>
 #include <utility>
 
@@ -9,12 +10,16 @@
 #include "socket.hh"
 
 #include "block.hh"
+#include "block_codec.hh"
+#include "bucket_store.hh"
 #include "cluster_map.hh"
 #include "disk_writer.hh"
 #include "meth4_knobs.hh"
 
-/* Handle receiving data from a single node in the cluster. Will receive data
- * for all buckets. */
+class Receiver;
+
+/* Handle receiving data from a single stream from a node in the cluster. Will
+ * receive data for all buckets. */
 class NetIn
 {
 private:
@@ -25,7 +30,7 @@ private:
   enum wire_state_t { IDLE, HEADER, PARSE, BODY, DONE };
 
   ClusterMap & cluster_;
-  std::vector<DiskWriter> & disks_;
+  Receiver & receiver_;
   size_t bucketsLive_;
 
   TCPSocket sock_;
@@ -36,17 +41,33 @@ private:
   size_t bucketLocalID_;
   size_t bodyOnWire_;
 
+  /* Trailing partial record of the last body read, held back as the bucket
+   * block is shared with all other NetIn's */
+  uint8_t partial_[Rec::SIZE];
+  size_t partialLen_;
+
+  /* Encoded blocks are read whole (into a pool buffer), then decoded straight
+   * onto the end of the bucket's block (so there's never a partial record) */
+  BlockCodec codec_;
+  uint8_t * wire_;
+  size_t wireLen_;
+
+  /* Decode the block read into wire_ onto the end of the bucket's block */
+  void appendEncoded( block_t & block );
+
   bool cantMove_;
 
 public:
-  NetIn( ClusterMap & cluster, std::vector<DiskWriter> & disks,
-         TCPSocket sock );
+  NetIn( ClusterMap & cluster, Receiver & receiver, TCPSocket sock );
 
   /* allow move */
   NetIn( NetIn && other );
 
   /* disable copy */
   NetIn( const NetIn & ) = delete;
+  NetIn & operator=( const NetIn & ) = delete;
+
+  ~NetIn( void );
 
   /* Hack: we disable the ability to move, called once we take a reference. */
   void disableMove( void ) noexcept { cantMove_ = true; }
@@ -61,12 +82,16 @@ class Receiver
 {
 public:
   static constexpr bool NET_NON_BLOCKING = Knobs4::NET_NON_BLOCKING;
+  static constexpr size_t NET_STREAMS = Knobs4::NET_STREAMS_PER_NODE;
   static constexpr size_t DISK_BLOCK_SIZE =
     Knobs4::DISK_W_BLOCK_SIZE * Rec::SIZE;
 
   static_assert( DISK_BLOCK_SIZE % Rec::SIZE == 0,
     "DISK_BLOCK_SIZE not a multiple of Rec::SIZE");
 
+  /* Sent by a node over each of its streams once all of them are connected */
+  static constexpr char BARRIER = 'B';
+
 private:
   ClusterMap & cluster_;
   Poller poll_;
@@ -76,8 +101,17 @@ private:
   size_t backendsLive_;
   std::vector<DiskWriter> disks_;
 
+  /* EOFs seen per local bucket, a bucket is complete once it has seen one
+   * from every sender over every stream */
+  std::mutex eofMtx_;
+  std::vector<size_t> eofs_;
+  size_t eofsExpected_;
+
+  /* Record an EOF for a bucket, closing it once complete */
+  void bucketEOF( uint16_t bkt );
+
 public:
-  Receiver( ClusterMap & cluster, Address address );
+  Receiver( ClusterMap & cluster, BucketStore & store, Address address );
   ~Receiver( void );
 
   /* Disable copy & move */
@@ -86,8 +120,18 @@ public:
   Receiver & operator=( const Receiver & ) = delete;
   Receiver & operator=( Receiver && ) = delete;
 
-  /* Handle the network receive side */
+  /* Accept connections from all other nodes, returning once every one of
+   * them has connected to the whole cluster (so the shuffle can start) */
   void waitForConnections( void );
+
+  /* Hand a block (or EOF if no buffer) for one of our buckets to disk, used
+   * by both NetIn and local senders by-passing the network. Safe to call from
+   * any thread. */
+  void deliver( block_t block );
+
+  /* Channel of buckets on a disk that are complete and closed */
+  Channel<uint16_t> closedBuckets( size_t diskID );
+
   void receiveLoop( void );
   void waitFinished( void );
 };
@@ -1,52 +1,105 @@
+#include <memory>
+
+#include "exception.hh"
 #include "sync_print.hh"
 
+#include "buffer_pool.hh"
 #include "meth4_knobs.hh"
 #include "send.hh"
 
 using namespace std;
 
-// Allocation helper
-static uint8_t * newBlock( void )
+// Allocation helper for cache-line aligned partitioning buffers
+static uint8_t * newAligned( size_t len )
 {
-  return (uint8_t *) malloc( NetOut::NET_BLOCK_SIZE );
+  uint8_t * buf;
+  SystemCall( "posix_memalign", posix_memalign( (void **) &buf,
+    Sender::CACHE_LINE, len ) );
+  return buf;
 }
 
-// De-allocation helper
-static void freeBlock( uint8_t * buf )
+// Connect to a node, retrying with backoff while it isn't yet listening
+static TCPSocket connectWithBackoff( const Address & addr )
 {
-  free( buf );
+  auto start = time_now();
+  size_t backoff = Knobs4::CONNECT_BACKOFF_MS;
+  while ( true ) {
+    TCPSocket sock{(IPVersion) addr.domain()};
+    sock.set_nodelay();
+    sock.set_send_buffer( Knobs4::NET_SND_BUF );
+    sock.set_recv_buffer( Knobs4::NET_RCV_BUF );
+    try {
+      sock.connect( addr );
+      return sock;
+    } catch ( const unix_error & e ) {
+      if ( e.code().value() != ECONNREFUSED
+          or time_diff<ms>( start ) >= Knobs4::CONNECT_TIMEOUT * 1000 ) {
+        throw;
+      }
+    }
+    this_thread::sleep_for( chrono::milliseconds( backoff ) );
+    backoff = min( backoff * 2, Knobs4::CONNECT_BACKOFF_MAX_MS );
+  }
 }
 
-// NOTE: We don't bother to remove our own node from the list of sockets to
-// listen on and send to. Instead, we let the data get transferred (locally)
-// over the network stack as this is not a limiting factor and avoiding this
-// would complicate the code a lot by introducing non-uniformity.
+// NOTE: Blocks for our own node's buckets don't go over the network, they're
+// handed straight to the local receiver's disk writers. So we don't connect to
+// ourselves and the receiver doesn't expect us to.
 
-NetOut::NetOut( ClusterMap & cluster )
+NetOut::NetOut( ClusterMap & cluster, Receiver & local )
   : sockets_{}
   , cluster_{cluster}
-  , queue_{NET_QUEUE_LENGTH}
+  , local_{local}
+  , queues_{}
   , netsend_{}
 {
-  // PERF: May need multiple threads here to saturate network
-  for ( const auto & c : cluster_.addresses() ) {
-    TCPSocket sock{(IPVersion) c.domain()};
-    sock.set_nodelay();
-    sock.set_send_buffer( Knobs4::NET_SND_BUF );
-    sock.set_recv_buffer( Knobs4::NET_RCV_BUF );
-    print( "p0", "connect", c.to_string() );
-    sock.connect( c );
-    sockets_.push_back( move( sock ) );
+  size_t streams = ( cluster_.nodes() - 1 ) * NET_STREAMS;
+  size_t qlen = max( NET_QUEUE_LENGTH / max( streams, size_t( 1 ) ),
+    size_t( 1 ) );
+
+  vector<Address> addrs = cluster_.addresses();
+  for ( size_t n = 0; n < addrs.size(); n++ ) {
+    for ( size_t i = 0; i < NET_STREAMS; i++ ) {
+      queues_.emplace_back( qlen );
+      if ( n == cluster_.myID() ) {
+        sockets_.emplace_back( (IPVersion) addrs[n].domain() ); // unused
+        continue;
+      }
+      print( "p0", "connect", addrs[n].to_string(), i );
+      sockets_.push_back( connectWithBackoff( addrs[n] ) );
+    }
+  }
+
+  // barrier: tell each node we're connected to it and everyone else, see
+  // Receiver::waitForConnections
+  for ( size_t i = 0; i < sockets_.size(); i++ ) {
+    if ( i / NET_STREAMS != cluster_.myID() ) {
+      sockets_[i].write_all( &Receiver::BARRIER, 1 );
+    }
   }
 
-  netsend_ = thread( &NetOut::sendLoop, this );
+  for ( size_t i = 0; i < sockets_.size(); i++ ) {
+    if ( i / NET_STREAMS != cluster_.myID() ) {
+      netsend_.emplace_back( &NetOut::sendLoop, this, i );
+    }
+  }
 }
 
 NetOut::~NetOut( void )
 {
-  queue_.waitEmpty();
-  queue_.close();
-  if ( netsend_.joinable() ) { netsend_.join(); }
+  for ( auto & q : queues_ ) {
+    q.waitEmpty();
+    q.close();
+  }
+  for ( auto & t : netsend_ ) {
+    if ( t.joinable() ) { t.join(); }
+  }
+}
+
+size_t NetOut::stream( uint16_t bkt ) const noexcept
+{
+  return cluster_.bucket_node( bkt ) * NET_STREAMS
+    + cluster_.bucket_local_id( bkt ) % NET_STREAMS;
 }
 
 void sendRPCHeader( TCPSocket & sock, uint16_t bkt, size_t len )
@@ -64,18 +117,28 @@ void sendRPCBody( TCPSocket & sock, uint8_t * buf, size_t len )
   sock.write_all( (char *) buf, len );
 }
 
-void NetOut::sendLoop( void )
+void NetOut::sendLoop( size_t stream )
 {
-  print( "p1", "netout-start", timestamp<ms>() );
+  print( "p1", "netout-start", timestamp<ms>(), stream );
   auto t0 = time_now();
   tdiff_t tnet = 0;
 
-  size_t activeBuckets = cluster_.buckets() * cluster_.disks();
+  TCPSocket & sock = sockets_[stream];
+  Channel<block_t> & queue = queues_[stream];
+
+  // blocks are encoded into here before sending, if enabled
+  BlockCodec codec( NET_BLOCK_SIZE );
+  unique_ptr<uint8_t, void (*)( uint8_t * )> wire( BlockCodec::ENABLED
+    ? blockPool().get( BlockCodec::maxEncoded( NET_BLOCK_SIZE ) ) : nullptr,
+    freeBlock );
+  uint64_t rawBytes = 0, wireBytes = 0;
+
+  // every stream sees the EOF for each of the node's buckets from each disk
+  size_t activeBuckets = cluster_.buckets() / cluster_.nodes()
+    * cluster_.disks();
   try {
     while ( activeBuckets > 0 ) {
-      block_t block = queue_.recv();
-      size_t nodeID = cluster_.bucket_node( block.bucket );
-      TCPSocket & sock = sockets_[nodeID];
+      block_t block = queue.recv();
 
       // PERF: Overhead of taking this many timestamps?
       auto t1 = time_now();
@@ -84,11 +147,18 @@ void NetOut::sendLoop( void )
         sendRPCHeader( sock, block.bucket, 0 );
         tnet += time_diff<us>( t1 );
       } else {
-        // PERF: hopefully we won't block so much here to a individual node as
-        // to hurt overall network performance.
-        sendRPCHeader( sock, block.bucket, block.len );
-        sendRPCBody( sock, block.buf, block.len );
+        uint8_t * body = block.buf;
+        size_t len = block.len;
+        if ( BlockCodec::ENABLED ) {
+          len = codec.encode( block.buf, block.len, wire.get() );
+          body = wire.get();
+        }
+        // blocking here only holds up this stream's queue
+        sendRPCHeader( sock, block.bucket, len );
+        sendRPCBody( sock, body, len );
         tnet += time_diff<us>( t1 );
+        rawBytes += block.len;
+        wireBytes += len;
         freeBlock( block.buf );
       }
     }
@@ -97,12 +167,24 @@ void NetOut::sendLoop( void )
   }
 
   tnet /= 1000;
-  print( "p1", "netout-done", timestamp<ms>(), time_diff<ms>( t0 ), tnet );
+  print( "p1", "netout-done", timestamp<ms>(), time_diff<ms>( t0 ), tnet,
+    stream, rawBytes, wireBytes );
 }
 
 void NetOut::send( block_t block )
 {
-  queue_.send( block );
+  size_t node = cluster_.bucket_node( block.bucket );
+  if ( node == cluster_.myID() ) {
+    // local bucket -- bypass the network
+    local_.deliver( block );
+  } else if ( block.buf == nullptr ) {
+    // EOF -- each stream to the node needs to see it
+    for ( size_t i = 0; i < NET_STREAMS; i++ ) {
+      queues_[node * NET_STREAMS + i].send( block );
+    }
+  } else {
+    queues_[stream( block.bucket )].send( block );
+  }
 }
 
 Sender::Sender( File & file, ClusterMap & cluster, NetOut & net  )
@@ -112,6 +194,10 @@ Sender::Sender( File & file, ClusterMap & cluster, NetOut & net  )
   , buckets_{cluster.buckets()}
   , sorter_{}
   , start_{}
+  , batch_{newAligned( BATCH_RECS * Rec::SIZE )}
+  , batchBkts_( BATCH_RECS )
+  , wc_{newAligned( cluster.buckets() * WC_STRIDE )}
+  , wcRecs_( cluster.buckets(), 0 )
 {
   for ( uint16_t i = 0; i < buckets_.size(); i++ ) {
     buckets_[i] = {newBlock(), 0, i};
@@ -121,38 +207,75 @@ Sender::Sender( File & file, ClusterMap & cluster, NetOut & net  )
 Sender::~Sender( void )
 {
   waitFinished();
+  free( batch_ );
+  free( wc_ );
   print( "p1", "send-end", timestamp<ms>(), time_diff<ms>( start_ ) );
 }
 
+// Copy a bucket's write-combining buffer into its network block (a single
+// sequential copy), sending the block on if that fills it.
+void Sender::flushWC( uint16_t bkt )
+{
+  block_t & bucket = buckets_[bkt];
+  size_t len = wcRecs_[bkt] * Rec::SIZE;
+  memcpy( bucket.buf + bucket.len, wc_ + bkt * WC_STRIDE, len );
+  bucket.len += len;
+  wcRecs_[bkt] = 0;
+
+  if ( bucket.len == NetOut::NET_BLOCK_SIZE ) {
+    net_.send( bucket );
+    bucket.buf = newBlock();
+    bucket.len = 0;
+  }
+}
+
+// Scatter a staged batch into the write-combining buffers. These are small
+// enough to all stay cache (and TLB) resident, so only the flushes touch the
+// large per-bucket network blocks.
+void Sender::partitionBatch( size_t nrecs )
+{
+  for ( size_t i = 0; i < nrecs; i++ ) {
+    uint16_t bkt = batchBkts_[i];
+    uint8_t * wc = wc_ + bkt * WC_STRIDE + wcRecs_[bkt] * Rec::SIZE;
+    memcpy( wc, batch_ + i * Rec::SIZE, Rec::SIZE );
+    if ( ++wcRecs_[bkt] == WC_RECS ) {
+      flushWC( bkt );
+    }
+  }
+}
+
 void Sender::_start( void )
 {
   auto t0 = time_now();
   rio_.rewind();
 
-  while ( true ) {
-    // get next record from disk
-    RecordPtr rec = rio_.next_record();
-    if ( rec.isNull() ) {
-      break;
+  bool more = true;
+  while ( more ) {
+    // pass one: stage a batch of records from disk and classify them
+    size_t n = 0;
+    for ( ; n < BATCH_RECS; n++ ) {
+      RecordPtr rec = rio_.next_record();
+      if ( rec.isNull() ) {
+        more = false;
+        break;
+      }
+      memcpy( batch_ + n * Rec::SIZE, rec.data(), Rec::SIZE );
+      batchBkts_[n] = cluster_.bucket( rec.key() );
     }
 
-    // place record into bucket
-    size_t bkt = cluster_.bucket( rec.key() );
-    block_t & bucket = buckets_[bkt];
-    memcpy( bucket.buf + bucket.len, rec.data(), Rec::SIZE );
-    bucket.len += Rec::SIZE;
-
-    // send full bucket
-    if ( bucket.len == NetOut::NET_BLOCK_SIZE ) {
-      net_.send( bucket );
-      bucket.buf = newBlock();
-      bucket.len = 0;
-    }
+    // pass two: scatter batch into buckets
+    partitionBatch( n );
   }
 
   // drain all buckets
   for ( auto & bkt : buckets_ ) {
-    net_.send( bkt );
+    flushWC( bkt.bucket );
+    if ( bkt.len > 0 ) {
+      net_.send( bkt );
+    } else {
+      // a zero length body is an EOF on the wire
+      freeBlock( bkt.buf );
+    }
     bkt.buf = nullptr;
     bkt.len = 0;
     net_.send( bkt ); // EOF
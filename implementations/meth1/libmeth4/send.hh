@@ -15,8 +15,10 @@
 #include "record.hh"
 
 #include "block.hh"
+#include "block_codec.hh"
 #include "meth4_knobs.hh"
 #include "cluster_map.hh"
+#include "recv.hh"
 
 class NetOut
 {
@@ -26,20 +28,34 @@ public:
 
   static constexpr size_t NET_QUEUE_LENGTH = Knobs4::NET_QUEUE_LENGTH;
   static constexpr size_t NET_BLOCK_SIZE = Knobs4::NET_BLOCK_SIZE * Rec::SIZE;
+  static constexpr size_t NET_STREAMS = Knobs4::NET_STREAMS_PER_NODE;
 
   static_assert( NET_BLOCK_SIZE % Rec::SIZE == 0,
     "NET_BLOCK_SIZE not a multiple of Rec::SIZE" );
 
+  static_assert( NET_STREAMS > 0, "NET_STREAMS must be at least one" );
+
+  /* Blocks for local buckets are handed to the disk writers as-is */
+  static_assert( NET_BLOCK_SIZE == DiskWriter::BLOCK_SIZE,
+    "NET_BLOCK_SIZE not the same as DISK_W_BLOCK_SIZE" );
+
 private:
+  /* Per outbound stream (indexed by node x NET_STREAMS + stream) state. Each
+   * stream has its own queue and thread so a slow node can't block sending to
+   * any other node. Our own node's streams are left unused. */
   std::vector<TCPSocket> sockets_;
   ClusterMap & cluster_;
-  Channel<block_t> queue_;
-  std::thread netsend_;
+  Receiver & local_;
+  std::vector<Channel<block_t>> queues_;
+  std::vector<std::thread> netsend_;
 
-  void sendLoop( void );
+  /* Stream a block for a bucket should be sent over */
+  size_t stream( uint16_t bkt ) const noexcept;
+
+  void sendLoop( size_t stream );
 
 public:
-  explicit NetOut( ClusterMap & cluster );
+  NetOut( ClusterMap & cluster, Receiver & local );
   ~NetOut( void );
 
   void send( block_t block );
@@ -47,6 +63,18 @@ public:
 
 class Sender
 {
+public:
+  static constexpr size_t BATCH_RECS = Knobs4::PART_BATCH_RECS;
+  static constexpr size_t WC_RECS = Knobs4::PART_WC_RECS;
+
+  /* Write-combining buffers are padded out to whole cache lines */
+  static constexpr size_t CACHE_LINE = 64;
+  static constexpr size_t WC_STRIDE =
+    ( WC_RECS * Rec::SIZE + CACHE_LINE - 1 ) / CACHE_LINE * CACHE_LINE;
+
+  static_assert( NetOut::NET_BLOCK_SIZE % ( WC_RECS * Rec::SIZE ) == 0,
+    "NET_BLOCK_SIZE not a multiple of the write-combining buffer size" );
+
 private:
   static constexpr size_t DISK_QUEUE_LENGTH = Knobs4::DISK_R_QUEUE_LENGTH;
 
@@ -57,12 +85,23 @@ private:
   std::thread sorter_;
   tpoint_t start_;
 
+  /* Partitioning state: a staged batch of records with their buckets, and a
+   * small write-combining buffer per bucket. */
+  uint8_t * batch_;
+  std::vector<uint16_t> batchBkts_;
+  uint8_t * wc_;
+  std::vector<size_t> wcRecs_;
+
   void _start( void );
+  void partitionBatch( size_t nrecs );
+  void flushWC( uint16_t bkt );
 
 public:
   Sender( File & file, ClusterMap & cluster, NetOut & net );
   Sender( const Sender & ) = delete;
   Sender( Sender && ) = delete;
+  Sender & operator=( const Sender & ) = delete;
+  Sender & operator=( Sender && ) = delete;
   ~Sender( void );
 
   void start( void );
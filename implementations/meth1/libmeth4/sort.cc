@@ -1,6 +1,14 @@
+#include <endian.h>
+#include <unistd.h>
+
+#include <algorithm>
 #include <atomic>
+#include <cstring>
 #include <functional>
 #include <limits>
+#include <memory>
+#include <numeric>
+#include <queue>
 #include <thread>
 
 #include "config.h"
@@ -15,6 +23,7 @@
 
 #include "record.hh"
 
+#include "buffer_pool.hh"
 #include "meth4_knobs.hh"
 #include "sort.hh"
 
@@ -31,26 +40,45 @@ size_t odirectAlignSize( size_t len )
   return len;
 }
 
+// Bucket buffers are pooled, so we only fault their memory in once
 char * allocBucket( size_t len )
 {
-  char * buf;
-  SystemCall( "posix_memalign", posix_memalign( (void **) &buf,
-    IODevice::ODIRECT_ALIGN, len ) );
-  return buf;
+  return (char *) bucketPool().get( len );
 }
 
-BucketSorter::BucketSorter( const ClusterMap & cluster, uint16_t bkt )
+void freeBucketBuf( char * buf )
+{
+  bucketPool().put( (uint8_t *) buf );
+}
+
+uint64_t clientBytes( uint64_t bucketRecs, uint64_t limit )
+{
+  return min( bucketRecs, limit ) * Rec::SIZE;
+}
+
+BucketSorter::BucketSorter( const ClusterMap & cluster, BucketStore & store,
+                            uint16_t bkt, bool presorted )
   : cluster_{cluster}
+  , store_{store}
   , bkt_{bkt}
   , len_{0}
   , buf_{nullptr}
+  , presorted_{presorted}
+  , index_{}
+  , indexed_{false}
+  , external_{false}
 {}
 
 BucketSorter::BucketSorter( BucketSorter && other )
   : cluster_{other.cluster_}
+  , store_{other.store_}
   , bkt_{other.bkt_}
   , len_{other.len_}
   , buf_{other.buf_}
+  , presorted_{other.presorted_}
+  , index_{move( other.index_ )}
+  , indexed_{other.indexed_}
+  , external_{other.external_}
 {
   other.buf_ = nullptr;
 }
@@ -62,48 +90,380 @@ BucketSorter::~BucketSorter( void )
 
 void BucketSorter::loadBucket( void )
 {
-  File in( cluster_.bucket_path( bkt_ ), O_RDONLY, File::DIRECT );
+  // resident buckets are already held in memory, but may still be too big to
+  // sort there (the store's budget isn't the sort's), so write those out and
+  // sort them from disk like any other
+  if ( not presorted_ and store_.resident( bkt_ ) ) {
+    if ( store_.size( bkt_ ) <= cluster_.bucketMaxSize() ) {
+      len_ = store_.size( bkt_ );
+      buf_ = allocBucket( odirectAlignSize( len_ ) );
+      store_.take( bkt_, buf_ );
+      return;
+    }
+    store_.writeOut( bkt_ );
+  }
+
+  File in( presorted_ ? cluster_.sorted_bucket_path( bkt_ )
+                      : cluster_.bucket_path( bkt_ ), O_RDONLY, File::DIRECT );
   len_ = in.size();
   if ( len_ % Rec::SIZE != 0 ) {
     throw runtime_error( "Bucket not a multiple of record size" );
+  } else if ( len_ > cluster_.bucketMaxSize() ) {
+    // too big to hold, sort (or stream) it from disk instead
+    external_ = true;
+    return;
   }
   size_t blen = odirectAlignSize( len_ );
   buf_ = allocBucket( blen );
   in.read( buf_, blen );
 }
 
+void BucketSorter::loadBucket( IODevice & in, uint64_t len )
+{
+  if ( len % Rec::SIZE != 0 ) {
+    throw runtime_error( "Bucket not a multiple of record size" );
+  } else if ( len > cluster_.bucketMaxSize() ) {
+    throw runtime_error( "Given a bucket too big to sort" );
+  }
+  len_ = len;
+  buf_ = allocBucket( odirectAlignSize( len_ ) );
+  if ( in.read_all( buf_, len_ ) != len_ ) {
+    throw runtime_error( "Bucket shorter than expected" );
+  }
+}
+
+void BucketSorter::sendUnsorted( IODevice & out )
+{
+  if ( buf_ == nullptr and len_ > 0 ) {
+    throw runtime_error( "Bucket not loaded" );
+  }
+  out.write_all( buf_, len_ );
+}
+
+// Sort key-index pairs by prefix with an LSD radix sort, a byte per pass.
+// Bytes that all prefixes share (common, as a bucket covers a narrow key
+// range) are skipped.
+static void radixSort( vector<KeyIndex> & keys )
+{
+  size_t n = keys.size();
+  if ( n == 0 ) {
+    return;
+  }
+
+  size_t counts[sizeof( uint64_t )][256] = {};
+  for ( auto & k : keys ) {
+    uint64_t p = k.prefix;
+    for ( size_t b = 0; b < sizeof( uint64_t ); b++, p >>= 8 ) {
+      counts[b][p & 0xFF]++;
+    }
+  }
+
+  vector<KeyIndex> tmp( n );
+  KeyIndex * src = keys.data();
+  KeyIndex * dst = tmp.data();
+  for ( size_t b = 0; b < sizeof( uint64_t ); b++ ) {
+    size_t shift = 8 * b;
+    size_t * c = counts[b];
+    if ( c[( src[0].prefix >> shift ) & 0xFF] == n ) {
+      continue;
+    }
+    for ( size_t i = 0, off = 0; i < 256; i++ ) {
+      size_t cnt = c[i];
+      c[i] = off;
+      off += cnt;
+    }
+    for ( size_t i = 0; i < n; i++ ) {
+      dst[c[( src[i].prefix >> shift ) & 0xFF]++] = src[i];
+    }
+    swap( src, dst );
+  }
+
+  if ( src != keys.data() ) {
+    keys.swap( tmp );
+  }
+}
+
 void BucketSorter::sortBucket( void )
 {
-  RecordString * recs = (RecordString *) buf_;
-  rec_sort( recs, recs + ( len_ / Rec::SIZE ) );
+  if ( presorted_ ) {
+    return;
+  } else if ( external_ ) {
+    sortExternal();
+  } else {
+    sortBuffer( len_ );
+  }
+}
+
+void BucketSorter::sortBuffer( size_t len )
+{
+  size_t n = len / Rec::SIZE;
+  if ( not KEY_INDEX or n > numeric_limits<uint32_t>::max() ) {
+    RecordString * recs = (RecordString *) buf_;
+    rec_sort( recs, recs + n );
+    return;
+  }
+
+  // build (prefix, index) pairs and sort them, the records stay put
+  index_.resize( n );
+  for ( size_t i = 0; i < n; i++ ) {
+    uint64_t p;
+    memcpy( &p, buf_ + i * Rec::SIZE, sizeof( p ) );
+    index_[i] = {be64toh( p ), uint32_t( i )};
+  }
+  radixSort( index_ );
+
+  // prefixes only cover part of the key, so order any runs of equal prefixes
+  // by the full key
+  const char * buf = buf_;
+  auto keyLess = [buf]( const KeyIndex & a, const KeyIndex & b ) {
+    return memcmp( buf + size_t( a.idx ) * Rec::SIZE,
+                   buf + size_t( b.idx ) * Rec::SIZE, Rec::KEY_LEN ) < 0;
+  };
+  for ( size_t i = 0; i < n; ) {
+    size_t j = i + 1;
+    while ( j < n and index_[j].prefix == index_[i].prefix ) {
+      j++;
+    }
+    if ( j - i > 1 ) {
+      sort( index_.begin() + i, index_.begin() + j, keyLess );
+    }
+    i = j;
+  }
+  indexed_ = true;
+}
+
+// Sequential reader over a sorted run, a buffer at a time. Runs are read
+// without O_DIRECT, as buffers hold whole records rather than aligned blocks.
+class RunReader
+{
+private:
+  File in_;
+  unique_ptr<char[]> buf_;
+  size_t cap_;
+  size_t len_;
+  size_t pos_;
+
+  void refill( void )
+  {
+    len_ = in_.read_all( buf_.get(), cap_ );
+    pos_ = 0;
+  }
+
+public:
+  RunReader( string path, size_t cap )
+    : in_{path, O_RDONLY}
+    , buf_{new char[cap]}
+    , cap_{cap}
+    , len_{0}
+    , pos_{0}
+  {
+    refill();
+  }
+
+  bool done( void ) const noexcept { return pos_ >= len_; }
+
+  const char * rec( void ) const noexcept { return buf_.get() + pos_; }
+
+  void next( void )
+  {
+    pos_ += Rec::SIZE;
+    if ( pos_ >= len_ ) {
+      refill();
+    }
+  }
+};
+
+void BucketSorter::sortExternal( void )
+{
+  auto t0 = time_now();
+
+  // the bucket is read a run at a time with O_DIRECT, so keep runs a multiple
+  // of both the O_DIRECT alignment and the record size
+  constexpr size_t RUN_ALIGN = Rec::SIZE * IODevice::ODIRECT_ALIGN;
+  size_t runLen = max( RUN_ALIGN,
+    cluster_.bucketMaxSize() / RUN_ALIGN * RUN_ALIGN );
+
+  // sort memory-sized runs
+  vector<string> runs;
+  {
+    File in( cluster_.bucket_path( bkt_ ), O_RDONLY, File::DIRECT );
+    buf_ = allocBucket( runLen );
+    for ( uint64_t off = 0; off < len_; off += runLen ) {
+      size_t n = min( uint64_t( runLen ), len_ - off );
+      for ( size_t got = 0; got < n; ) {
+        size_t r = in.read( buf_ + got, odirectAlignSize( n ) - got );
+        if ( r == 0 ) {
+          throw runtime_error( "Bucket shorter than expected" );
+        }
+        got += r;
+      }
+
+      sortBuffer( n );
+      runs.push_back( cluster_.bucket_run_path( bkt_, runs.size() ) );
+      File run( runs.back(), O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR );
+      writeSorted( run, n );
+      vector<KeyIndex>().swap( index_ );
+      indexed_ = false;
+    }
+    freeBucketBuf( buf_ );
+    buf_ = nullptr;
+  }
+  auto t1 = time_now();
+
+  mergeRuns( runs );
+  for ( auto & r : runs ) {
+    SystemCall( "unlink", unlink( r.c_str() ) );
+  }
+
+  print( "external-sort", timestamp<ms>(), bkt_, len_, runs.size(),
+    time_diff<ms>( t1, t0 ), time_diff<ms>( t1 ) );
+}
+
+// k-way merge of the sorted runs into the sorted bucket file. We read each run
+// through its own buffer, splitting the memory we'd sort a bucket in between
+// them, and write out in large aligned blocks with O_DIRECT.
+void BucketSorter::mergeRuns( const vector<string> & runs )
+{
+  constexpr size_t OUT_LEN = Knobs4::DISK_W_BLOCK_SIZE * Rec::SIZE;
+  size_t inLen = max( Rec::SIZE * 1024,
+    cluster_.bucketMaxSize() / 2 / runs.size() / Rec::SIZE * Rec::SIZE );
+
+  vector<unique_ptr<RunReader>> readers;
+  auto cmp = [&readers]( size_t a, size_t b ) {
+    return memcmp( readers[a]->rec(), readers[b]->rec(), Rec::KEY_LEN ) > 0;
+  };
+  priority_queue<size_t, vector<size_t>, decltype( cmp )> heap( cmp );
+  for ( auto & r : runs ) {
+    readers.emplace_back( new RunReader( r, inLen ) );
+    if ( not readers.back()->done() ) {
+      heap.push( readers.size() - 1 );
+    }
+  }
+
+  File out( cluster_.sorted_bucket_path( bkt_ ), O_WRONLY | O_CREAT | O_TRUNC,
+    S_IRUSR | S_IWUSR, File::DIRECT );
+  char * obuf = allocBucket( OUT_LEN );
+  size_t olen = 0;
+  BucketSummary sum;
+  while ( not heap.empty() ) {
+    size_t i = heap.top();
+    heap.pop();
+    memcpy( obuf + olen, readers[i]->rec(), Rec::SIZE );
+    olen += Rec::SIZE;
+    if ( olen == OUT_LEN ) {
+      if ( SUMMARIZE ) {
+        sum.add( (uint8_t *) obuf, olen );
+      }
+      out.write_all( obuf, olen );
+      olen = 0;
+    }
+    readers[i]->next();
+    if ( not readers[i]->done() ) {
+      heap.push( i );
+    }
+  }
+
+  // pad the last block to the O_DIRECT alignment, then truncate it off
+  if ( olen > 0 ) {
+    if ( SUMMARIZE ) {
+      sum.add( (uint8_t *) obuf, olen );
+    }
+    size_t padded = odirectAlignSize( olen );
+    memset( obuf + olen, 0, padded - olen );
+    out.write_all( obuf, padded );
+    out.truncate( len_ );
+  }
+  out.fsync();
+  freeBucketBuf( obuf );
+  saveSummary( sum );
+}
+
+void BucketSorter::writeSorted( IODevice & out, uint64_t len,
+                                BucketSummary * sum )
+{
+  if ( external_ and buf_ == nullptr ) {
+    constexpr size_t CHUNK = Knobs4::DISK_W_BLOCK_SIZE * Rec::SIZE;
+    File in( cluster_.sorted_bucket_path( bkt_ ), O_RDONLY );
+    unique_ptr<char[]> chunk( new char[CHUNK] );
+    for ( uint64_t n = 0; n < len; ) {
+      size_t r = in.read_all( chunk.get(), min( uint64_t( CHUNK ), len - n ) );
+      if ( r == 0 ) {
+        throw runtime_error( "Sorted bucket shorter than expected" );
+      }
+      if ( sum != nullptr ) {
+        sum->add( (uint8_t *) chunk.get(), r );
+      }
+      out.write_all( chunk.get(), r );
+      n += r;
+    }
+    return;
+  } else if ( not indexed_ ) {
+    if ( sum != nullptr ) {
+      sum->add( (uint8_t *) buf_, len );
+    }
+    out.write_all( buf_, len );
+    return;
+  }
+
+  // gather records into order a chunk at a time
+  constexpr size_t CHUNK_RECS = 1024 * 10; // ~ 1MB
+  unique_ptr<char[]> chunk( new char[CHUNK_RECS * Rec::SIZE] );
+  uint64_t recs = len / Rec::SIZE;
+  for ( uint64_t i = 0; i < recs; ) {
+    size_t m = min( uint64_t( CHUNK_RECS ), recs - i );
+    for ( size_t j = 0; j < m; j++ ) {
+      memcpy( chunk.get() + j * Rec::SIZE,
+        buf_ + size_t( index_[i + j].idx ) * Rec::SIZE, Rec::SIZE );
+    }
+    if ( sum != nullptr ) {
+      sum->add( (uint8_t *) chunk.get(), m * Rec::SIZE );
+    }
+    out.write_all( chunk.get(), m * Rec::SIZE );
+    i += m;
+  }
 }
 
 void BucketSorter::saveBucket( void )
 {
+  // external sorts save as they merge
+  if ( presorted_ or external_ ) {
+    return;
+  }
   File out( cluster_.sorted_bucket_path( bkt_ ),
     O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR );
-  out.write_all( buf_, len_ );
+  BucketSummary sum;
+  writeSorted( out, len_, SUMMARIZE ? &sum : nullptr );
   out.fsync();
+  saveSummary( sum );
+}
+
+void BucketSorter::saveSummary( const BucketSummary & sum ) const
+{
+  if ( SUMMARIZE ) {
+    sum.save( cluster_.bucket_summary_path( bkt_ ) );
+  }
 }
 
 void BucketSorter::sendBucket( TCPSocket & sock, uint64_t records )
 {
   auto t0 = time_now();
-  print( "send-bucket", timestamp<ms>(), bkt_, min( len_, records * Rec::SIZE ) );
-  sock.write_all( buf_, min( len_, records * Rec::SIZE ) );
+  uint64_t len = clientBytes( len_ / Rec::SIZE, records );
+  print( "send-bucket", timestamp<ms>(), bkt_, len );
+  writeSorted( sock, len );
   print( "sent-bucket", timestamp<ms>(), bkt_, time_diff<ms>( t0 ) );
 }
 
 void BucketSorter::freeBucket( void )
 {
   if ( buf_ != nullptr ) {
-    // PERF: Reuse buffes?
-    free( buf_ );
+    freeBucketBuf( buf_ );
     buf_ = nullptr;
   }
+  vector<KeyIndex>().swap( index_ );
+  indexed_ = false;
 }
 
-pair<uint64_t, bool> calculateOp( string op, string arg1 )
+op_range_t calculateOp( string op, string arg1 )
 {
   if ( op == "all" ) {
     return make_pair( std::numeric_limits<uint64_t>::max(), false );
@@ -122,23 +482,72 @@ pair<uint64_t, bool> calculateOp( string op, string arg1 )
   }
 }
 
-// Handle sorting all buckets on a single disk
-void sortDisk( const ClusterMap & cluster, size_t diskID, string op,
-               string arg1 )
+// Connection to the client for sending it sorted buckets
+TCPSocket connectClient( const ClusterMap & cluster )
+{
+  print( "sending-to-client", cluster.client().to_string() );
+  TCPSocket s( IPV4 );
+  s.set_nodelay();
+  s.set_send_buffer( Knobs::NET_SND_BUF );
+  s.set_recv_buffer( Knobs::NET_RCV_BUF );
+  s.connect( cluster.client() );
+  return s;
+}
+
+// Tell the client the buckets (and their lengths) we're about to send it, as a
+// count followed by a <uint16 bucket, uint64 len> header per bucket.
+void sendClientTable( TCPSocket & client,
+                      const vector<pair<uint16_t, uint64_t>> & table )
+{
+  constexpr size_t HDRSIZE = sizeof( uint16_t ) + sizeof( uint64_t );
+  string buf( sizeof( uint64_t ) + table.size() * HDRSIZE, 0 );
+  char * data = &buf[0];
+  *reinterpret_cast<uint64_t *>( data ) = table.size();
+  data += sizeof( uint64_t );
+  for ( auto & b : table ) {
+    *reinterpret_cast<uint16_t *>( data ) = b.first;
+    *reinterpret_cast<uint64_t *>( data + 2 ) = b.second;
+    data += HDRSIZE;
+  }
+  client.write_all( buf );
+}
+
+// Handle sorting all buckets an operation touches on a single disk. Buckets
+// marked as already sorted are only loaded if needed for the client, newly
+// sorted buckets are marked. Returns the number of buckets sorted.
+size_t sortDisk( const ClusterMap & cluster, BucketStore & store,
+                 size_t diskID, op_range_t range,
+                 function<bool( uint16_t )> touches, vector<uint8_t> & sorted )
 {
-  auto range = calculateOp( op, arg1 );
   bool toClient = range.second;
   uint64_t bktSize = cluster.bucketSizeAvg();
 
   // filter out buckets for my disk
-  vector<BucketSorter> bsorters;
-  size_t diskBuckets = 0;
+  vector<uint16_t> diskBkts;
   for ( auto bkt : cluster.myBuckets() ) {
     if ( cluster.bucket_disk( bkt ) == diskID ) {
-      diskBuckets++;
-      // check in sorting range
-      if ( bkt * bktSize <= range.first ) {
-        bsorters.emplace_back( cluster, bkt );
+      diskBkts.push_back( bkt );
+    }
+  }
+
+  // the client needs buckets in key order, but otherwise take those resident
+  // in memory first to free up their memory before loading the rest from disk
+  if ( not toClient ) {
+    stable_partition( diskBkts.begin(), diskBkts.end(),
+      [&store]( uint16_t bkt ) { return store.resident( bkt ); } );
+  }
+
+  vector<BucketSorter> bsorters;
+  size_t diskBuckets = diskBkts.size(), toSort = 0;
+  for ( auto bkt : diskBkts ) {
+    // check in sorting range
+    if ( touches( bkt ) ) {
+      bool done = sorted[cluster.bucket_local_id( bkt )];
+      if ( not done ) {
+        toSort++;
+        bsorters.emplace_back( cluster, store, bkt );
+      } else if ( toClient ) {
+        bsorters.emplace_back( cluster, store, bkt, true );
       }
     }
   }
@@ -146,22 +555,23 @@ void sortDisk( const ClusterMap & cluster, size_t diskID, string op,
   print( "sort-disk", timestamp<ms>(), diskID, diskBuckets, bsorters.size(),
     toClient );
 
-  // connect to client if needed
+  // connect to client if needed, telling it what we'll send
   TCPSocket client;
   if ( toClient ) {
-    print( "sending-to-client", cluster.client().to_string() );
-    TCPSocket s( IPV4 );
-    s.set_nodelay();
-    s.set_send_buffer( Knobs::NET_SND_BUF );
-    s.set_recv_buffer( Knobs::NET_RCV_BUF );
-    s.connect( cluster.client() );
-    client = move( s );
+    client = connectClient( cluster );
+    vector<pair<uint16_t, uint64_t>> table;
+    for ( auto & bs : bsorters ) {
+      uint64_t bktLim = range.first - bs.id() * bktSize;
+      table.emplace_back( bs.id(),
+        clientBytes( cluster.bucketSize( bs.id() ), bktLim ) );
+    }
+    sendClientTable( client, table );
   }
 
   // exit if nothing to send (but always connect to client as it expects all
   // backends to connect)
   if ( bsorters.size() == 0 ) {
-    return;
+    return 0;
   }
 
   tdiff_t tsort = 0, tsave = 0;
@@ -252,16 +662,348 @@ void sortDisk( const ClusterMap & cluster, size_t diskID, string op,
   }
 #endif
 
+  for ( auto & bs : bsorters ) {
+    sorted[cluster.bucket_local_id( bs.id() )] = true;
+  }
+
   print( "sort-disk", timestamp<ms>(), diskID, tload, tsort, tsave );
+  return toSort;
 }
 
-Sorter::Sorter( const ClusterMap & cluster, string op, string arg1 )
+// Run sortDisk for every disk in parallel
+size_t sortDisks( const ClusterMap & cluster, BucketStore & store,
+                  op_range_t range, function<bool( uint16_t )> touches,
+                  vector<uint8_t> & sorted )
 {
+  vector<size_t> counts( cluster.disks(), 0 );
   vector<thread> diskSorters;
   for ( size_t i = 0; i < cluster.disks(); i++ ) {
-    diskSorters.emplace_back( sortDisk, ref( cluster ), i, op, arg1 );
+    diskSorters.emplace_back(
+      [&cluster, &store, i, range, touches, &sorted, &counts]() {
+        counts[i] = sortDisk( cluster, store, i, range, touches, sorted );
+      } );
   }
   for ( auto & ds : diskSorters ) {
     ds.join();
   }
+  return accumulate( counts.begin(), counts.end(), size_t( 0 ) );
+}
+
+// Sort the buckets queued for a disk until its queue is closed and empty,
+// loading the next bucket while sorting one (if it's already queued).
+size_t sortQueue( const ClusterMap & cluster, BucketStore & store,
+                  size_t diskID, BucketQueue & queue )
+{
+  print( "sort-disk", timestamp<ms>(), diskID );
+
+  size_t n = 0;
+  tdiff_t twait = 0, tsort = 0, tsave = 0;
+  atomic<tdiff_t> tload;
+  tload.store( 0 );
+
+  unique_ptr<BucketSorter> cur, next;
+  uint16_t bkt;
+#ifdef HAVE_TBB_TASK_GROUP_H
+  tbb::task_group tg;
+#endif
+  while ( true ) {
+    if ( not cur ) {
+      auto t0 = time_now();
+      if ( not queue.next( diskID, bkt ) ) {
+        break;
+      }
+      auto t1 = time_now();
+      cur.reset( new BucketSorter( cluster, store, bkt ) );
+      cur->loadBucket();
+      twait += time_diff<ms>( t1, t0 );
+      tload += time_diff<ms>( t1 );
+    }
+
+#ifdef HAVE_TBB_TASK_GROUP_H
+    if ( queue.tryNext( diskID, bkt ) ) {
+      next.reset( new BucketSorter( cluster, store, bkt ) );
+      tg.run( [&next, &tload]() {
+        auto t0 = time_now();
+        next->loadBucket();
+        tload += time_diff<ms>( t0 );
+      } );
+    }
+#endif
+
+    auto t0 = time_now();
+    cur->sortBucket();
+    auto t1 = time_now();
+    cur->saveBucket();
+    auto t2 = time_now();
+#ifdef HAVE_TBB_TASK_GROUP_H
+    tg.wait();
+#endif
+    cur->freeBucket();
+    cur = move( next );
+    n++;
+
+    tsort += time_diff<ms>( t1, t0 );
+    tsave += time_diff<ms>( t2, t1 );
+  }
+
+  print( "sort-disk", timestamp<ms>(), diskID, n, tload.load(), tsort, tsave,
+    twait );
+  return n;
+}
+
+// Write out the buckets on a disk still held in memory once sorting is done,
+// which are those an operation didn't touch, so none are lost
+static void writeResident( const ClusterMap & cluster, BucketStore & store,
+                           size_t diskID )
+{
+  for ( auto bkt : cluster.myBuckets() ) {
+    if ( cluster.bucket_disk( bkt ) == diskID and store.resident( bkt ) ) {
+      store.writeOut( bkt );
+    }
+  }
+}
+
+Sorter::Sorter( const ClusterMap & cluster, BucketStore & store, string op,
+                string arg1 )
+  : queue_( cluster.disks() )
+  , diskSorters_{}
+{
+  auto range = calculateOp( op, arg1 );
+  uint64_t bktSize = cluster.bucketSizeAvg();
+  auto touches = [bktSize, range]( uint16_t bkt ) {
+    return bkt * bktSize <= range.first;
+  };
+
+  // the client is told up front what each node will send it, so those
+  // buckets are sorted where they are
+  if ( range.second ) {
+    for ( size_t i = 0; i < cluster.disks(); i++ ) {
+      queue_.close( i );
+    }
+    diskSorters_.emplace_back( [&cluster, &store, range, touches]() {
+      vector<uint8_t> sorted( cluster.myBuckets().size(), false );
+      sortDisks( cluster, store, range, touches, sorted );
+      for ( size_t i = 0; i < cluster.disks(); i++ ) {
+        writeResident( cluster, store, i );
+      }
+    } );
+    return;
+  }
+
+  // take those resident in memory first to free up their memory before
+  // loading the rest from disk
+  for ( bool resident : {true, false} ) {
+    for ( auto bkt : cluster.myBuckets() ) {
+      if ( touches( bkt ) and store.resident( bkt ) == resident ) {
+        queue_.push( cluster.bucket_disk( bkt ), bkt );
+      }
+    }
+  }
+  for ( size_t i = 0; i < cluster.disks(); i++ ) {
+    queue_.close( i );
+    diskSorters_.emplace_back( [&cluster, &store, i, this]() {
+      sortQueue( cluster, store, i, queue_ );
+      writeResident( cluster, store, i );
+    } );
+  }
+}
+
+Sorter::~Sorter( void )
+{
+  waitFinished();
+}
+
+void Sorter::waitFinished( void )
+{
+  for ( auto & ds : diskSorters_ ) {
+    if ( ds.joinable() ) { ds.join(); }
+  }
+}
+
+// Queue each bucket on a single disk for sorting as phase one closes it
+void feedQueue( const ClusterMap & cluster, size_t diskID,
+                Channel<uint16_t> closed, BucketQueue & queue )
+{
+  size_t diskBuckets = 0;
+  for ( auto bkt : cluster.myBuckets() ) {
+    if ( cluster.bucket_disk( bkt ) == diskID ) {
+      diskBuckets++;
+    }
+  }
+
+  for ( size_t i = 0; i < diskBuckets; i++ ) {
+    queue.push( diskID, closed.recv() );
+  }
+  queue.close( diskID );
+}
+
+StreamSorter::StreamSorter( const ClusterMap & cluster, BucketStore & store,
+                            string op, vector<Channel<uint16_t>> closed )
+  : queue_( cluster.disks() )
+  , feeders_{}
+  , diskSorters_{}
+{
+  if ( not canOverlap( op ) ) {
+    throw runtime_error( "Can't overlap operation: " + op );
+  }
+  for ( size_t i = 0; i < cluster.disks(); i++ ) {
+    feeders_.emplace_back( feedQueue, ref( cluster ), i, closed[i],
+      ref( queue_ ) );
+    diskSorters_.emplace_back( [&cluster, &store, i, this]() {
+      sortQueue( cluster, store, i, queue_ );
+    } );
+  }
+}
+
+StreamSorter::~StreamSorter( void )
+{
+  waitFinished();
+}
+
+bool StreamSorter::canOverlap( string op )
+{
+  // the client needs all bucket sizes before any bucket is sent to it, which
+  // we only have at the end of phase one
+  return op == "all";
+}
+
+void StreamSorter::waitFinished( void )
+{
+  for ( auto & f : feeders_ ) {
+    if ( f.joinable() ) { f.join(); }
+  }
+  for ( auto & ds : diskSorters_ ) {
+    if ( ds.joinable() ) { ds.join(); }
+  }
+}
+
+LazySorter::LazySorter( const ClusterMap & cluster, BucketStore & store )
+  : cluster_{cluster}
+  , store_{store}
+  , sorted_( cluster.myBuckets().size(), false )
+{}
+
+// We may sit idle between queries for a long time, so once a query's buckets
+// are sorted and drained, free their buffers rather than keep them pooled
+void LazySorter::trimPool( void )
+{
+  size_t bytes = bucketPool().trim();
+  if ( bytes > 0 ) {
+    print( "bucket-pool-trim", timestamp<ms>(), bytes );
+  }
+}
+
+uint64_t LazySorter::query( string op, string arg1 )
+{
+  auto t0 = time_now();
+  auto range = calculateOp( op, arg1 );
+
+  // positions are of our records (as range() reads ours), and bucket IDs are
+  // in key order, so our buckets' real sizes give where each starts -- an
+  // average would miss with skewed buckets
+  vector<uint64_t> starts( cluster_.myBuckets().size() );
+  uint64_t at = 0;
+  for ( auto bkt : cluster_.myBuckets() ) {
+    starts[cluster_.bucket_local_id( bkt )] = at;
+    at += cluster_.bucketSize( bkt );
+  }
+
+  // the client needs every record up to the limit, but otherwise `nth` only
+  // needs the bucket holding the record
+  bool single = op == "nth";
+  auto touches = [this, &starts, range, single]( uint16_t bkt ) {
+    uint64_t start = starts[cluster_.bucket_local_id( bkt )];
+    if ( single ) {
+      return start <= range.first
+        and range.first < start + cluster_.bucketSize( bkt );
+    }
+    return start <= range.first;
+  };
+
+  uint64_t n = sortDisks( cluster_, store_, range, touches, sorted_ );
+  trimPool();
+  print( "lazy-query", timestamp<ms>(), op, arg1, n, time_diff<ms>( t0 ) );
+  return n;
+}
+
+// Read len bytes at offset of a file
+static void readAt( File & in, char * buf, size_t len, off_t offset )
+{
+  while ( len > 0 ) {
+    size_t n = in.pread( buf, len, offset );
+    if ( n == 0 ) {
+      throw runtime_error( "Short read of sorted bucket" );
+    }
+    buf += n;
+    len -= n;
+    offset += n;
+  }
+}
+
+string LazySorter::range( const uint8_t * lo, const uint8_t * hi,
+                          uint64_t limit )
+{
+  static constexpr uint64_t CHUNK = 4096; // records
+
+  auto t0 = time_now();
+  uint16_t first = cluster_.bucket( lo ), last = cluster_.bucket( hi );
+  auto touches = [first, last]( uint16_t bkt ) {
+    return first <= bkt and bkt <= last;
+  };
+  uint64_t n = sortDisks( cluster_, store_,
+    make_pair( numeric_limits<uint64_t>::max(), false ), touches, sorted_ );
+  trimPool();
+
+  // bucket IDs are in key order, so we read ours in order, binary searching
+  // the sorted bucket for lo and reading on until hi, straight into the reply
+  limit = min( limit, Knobs4::RANGE_MAX_RECORDS );
+  uint64_t most = 0;
+  for ( auto bkt : cluster_.myBuckets() ) {
+    most += touches( bkt ) ? cluster_.bucketSize( bkt ) : 0;
+  }
+  string recs;
+  recs.reserve( min( limit, most ) * Rec::SIZE );
+  uint64_t nrecs = 0;
+  for ( auto bkt : cluster_.myBuckets() ) {
+    uint64_t size = cluster_.bucketSize( bkt );
+    if ( not touches( bkt ) or size == 0 ) {
+      continue;
+    } else if ( nrecs >= limit ) {
+      break;
+    }
+
+    File in( cluster_.sorted_bucket_path( bkt ), O_RDONLY );
+    char key[Rec::KEY_LEN];
+    uint64_t l = 0, h = size;
+    while ( l < h ) {
+      uint64_t m = l + ( h - l ) / 2;
+      readAt( in, key, Rec::KEY_LEN, m * Rec::SIZE );
+      if ( memcmp( key, lo, Rec::KEY_LEN ) < 0 ) {
+        l = m + 1;
+      } else {
+        h = m;
+      }
+    }
+
+    bool done = false;
+    for ( uint64_t i = l; i < size and nrecs < limit and not done; ) {
+      uint64_t cnt = min( min( size - i, CHUNK ), limit - nrecs );
+      recs.resize( ( nrecs + cnt ) * Rec::SIZE );
+      char * buf = &recs[nrecs * Rec::SIZE];
+      readAt( in, buf, cnt * Rec::SIZE, i * Rec::SIZE );
+      for ( uint64_t j = 0; j < cnt; j++ ) {
+        if ( memcmp( buf + j * Rec::SIZE, hi, Rec::KEY_LEN ) >= 0 ) {
+          cnt = j;
+          done = true;
+          break;
+        }
+      }
+      nrecs += cnt;
+      recs.resize( nrecs * Rec::SIZE );
+      i += cnt;
+    }
+  }
+
+  print( "lazy-range", timestamp<ms>(), n, nrecs, time_diff<ms>( t0 ) );
+  return recs;
 }
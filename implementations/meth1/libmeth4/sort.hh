@@ -2,26 +2,80 @@
 #define METH4_SORT_HH
 
 #include <string>
+#include <thread>
+#include <utility>
+#include <vector>
 
 #include "config.h"
 #ifdef HAVE_TBB_TASK_GROUP_H
 #include "tbb/task_group.h"
 #endif
 
+#include "channel.hh"
 #include "socket.hh"
 
+#include "bucket_queue.hh"
+#include "bucket_store.hh"
+#include "bucket_summary.hh"
 #include "cluster_map.hh"
+#include "meth4_knobs.hh"
+
+/* A record's key prefix (big-endian, so it orders as the key does) and its
+ * index in the bucket */
+struct KeyIndex
+{
+  uint64_t prefix;
+  uint32_t idx;
+} __attribute__(( packed ));
+
+// calcMaxSortSize (cluster_map.cc) budgets for two of these per record
+static_assert( sizeof( KeyIndex ) == 12, "KeyIndex size changed" );
 
 class BucketSorter
 {
+public:
+  /* Sort a compact (key prefix, index) array instead of moving records? */
+  static constexpr bool KEY_INDEX = Knobs4::SORT_KEY_INDEX;
+
+  /* Summarize buckets as they're saved? */
+  static constexpr bool SUMMARIZE = Knobs4::SORT_SUMMARIES;
+
 private:
   const ClusterMap & cluster_;
+  BucketStore & store_;
   uint16_t bkt_;
   size_t len_;
   char * buf_;
+  bool presorted_;
+  std::vector<KeyIndex> index_;
+  bool indexed_;
+  bool external_;
+
+  /* Sort the first len bytes of the buffer */
+  void sortBuffer( size_t len );
+
+  /* Sort a bucket too big for memory by sorting memory-sized runs of it and
+   * then merging them into the sorted bucket file */
+  void sortExternal( void );
+  void mergeRuns( const std::vector<std::string> & runs );
+
+  /* Write out the first len bytes of the sorted bucket, permuting the records
+   * into order as we go if sorted by key index (or streaming them from the
+   * sorted bucket file if not held in memory), summarizing what's written if
+   * given a summary */
+  void writeSorted( IODevice & out, uint64_t len,
+    BucketSummary * sum = nullptr );
+
+  /* Write out a bucket's summary (if enabled) */
+  void saveSummary( const BucketSummary & sum ) const;
 
 public:
-  BucketSorter( const ClusterMap & cluster, uint16_t bkt );
+  /* A bucket is loaded from memory if resident in the store, else from disk.
+   * A presorted bucket is loaded from its sorted file and not sorted or saved
+   * again. Buckets too big to sort in memory (i.e., from skewed inputs) are
+   * never fully loaded, instead being sorted by an external merge. */
+  BucketSorter( const ClusterMap & cluster, BucketStore & store, uint16_t bkt,
+    bool presorted = false );
   BucketSorter( const BucketSorter & ) = delete;
   BucketSorter( BucketSorter && );
   ~BucketSorter( void );
@@ -33,16 +87,93 @@ public:
 
   void loadBucket( void );
   void sortBucket( void );
+
+  /* Load a bucket another node gave us (see steal.hh) instead, or give a
+   * loaded (unsorted) bucket away */
+  void loadBucket( IODevice & in, uint64_t len );
+  void sendUnsorted( IODevice & out );
+  uint64_t size( void ) const noexcept { return len_; }
+
   void saveBucket( void );
   void sendBucket( TCPSocket & sock, uint64_t records );
   void freeBucket( void );
 };
 
+/* Operation limit (in records) and if sending to the client */
+using op_range_t = std::pair<uint64_t, bool>;
+
+/* Bytes of a bucket sent to the client under a limit (in records) */
+uint64_t clientBytes( uint64_t bucketRecs, uint64_t limit );
+
+/* Sorts all buckets an operation needs (eagerly). Unless sending them to the
+ * client, buckets are sorted from a queue other nodes can steal from. */
 class Sorter
 {
+private:
+  BucketQueue queue_;
+  std::vector<std::thread> diskSorters_;
+
 public:
-  explicit Sorter( const ClusterMap & cluster, std::string op,
+  Sorter( const ClusterMap & cluster, BucketStore & store, std::string op,
     std::string arg1 );
+  Sorter( const Sorter & ) = delete;
+  Sorter & operator=( const Sorter & ) = delete;
+  ~Sorter( void );
+
+  /* Buckets still waiting to be sorted */
+  BucketQueue & queue( void ) noexcept { return queue_; }
+
+  /* Wait for all buckets to be sorted */
+  void waitFinished( void );
+};
+
+/* Sorts buckets as phase one completes them, overlapping the two phases. */
+class StreamSorter
+{
+private:
+  BucketQueue queue_;
+  std::vector<std::thread> feeders_;
+  std::vector<std::thread> diskSorters_;
+
+public:
+  /* Takes a channel per disk announcing the buckets completed on it */
+  StreamSorter( const ClusterMap & cluster, BucketStore & store,
+    std::string op, std::vector<Channel<uint16_t>> closed );
+  StreamSorter( const StreamSorter & ) = delete;
+  StreamSorter & operator=( const StreamSorter & ) = delete;
+  ~StreamSorter( void );
+
+  /* Only operations that touch every bucket (and don't send to the client)
+   * can be overlapped */
+  static bool canOverlap( std::string op );
+
+  /* Buckets completed but still waiting to be sorted */
+  BucketQueue & queue( void ) noexcept { return queue_; }
+
+  /* Wait for all buckets to be sorted */
+  void waitFinished( void );
+};
+
+/* Sorts buckets lazily, only the first time a query touches them. Queries
+ * should be run one at a time. */
+class LazySorter
+{
+private:
+  const ClusterMap & cluster_;
+  BucketStore & store_;
+  std::vector<uint8_t> sorted_; // by local bucket ID
+
+  void trimPool( void );
+
+public:
+  LazySorter( const ClusterMap & cluster, BucketStore & store );
+
+  /* Run an operation, returning the number of buckets sorted for it */
+  uint64_t query( std::string op, std::string arg1 );
+
+  /* Our smallest (up to) limit records with keys in [lo, hi), sorting the
+   * buckets the range touches first. At most RANGE_MAX_RECORDS. */
+  std::string range( const uint8_t * lo, const uint8_t * hi, uint64_t limit );
 };
 
 #endif /* METH4_SORT_HH */
@@ -0,0 +1,289 @@
+#include <cstring>
+
+#include "exception.hh"
+#include "file.hh"
+#include "sync_print.hh"
+#include "timestamp.hh"
+
+#include "sort.hh"
+#include "steal.hh"
+
+using namespace std;
+
+static constexpr size_t HDRSIZE = sizeof( uint16_t ) + sizeof( uint64_t );
+
+// Send a <uint16 bucket, uint64 len> header, as phase one's blocks use
+static void sendHeader( TCPSocket & sock, uint16_t bkt, uint64_t len )
+{
+  char header[HDRSIZE];
+  memcpy( header, &bkt, sizeof( bkt ) );
+  memcpy( header + sizeof( bkt ), &len, sizeof( len ) );
+  sock.write_all( header, HDRSIZE );
+}
+
+static void recvHeader( TCPSocket & sock, uint16_t & bkt, uint64_t & len )
+{
+  string header = sock.read_all( HDRSIZE );
+  if ( header.size() != HDRSIZE ) {
+    throw runtime_error( "Truncated steal header" );
+  }
+  memcpy( &bkt, header.data(), sizeof( bkt ) );
+  memcpy( &len, header.data() + sizeof( bkt ), sizeof( len ) );
+}
+
+BucketStealer::BucketStealer( ClusterMap & cluster, BucketStore & store,
+                              BucketQueue & queue, Address address )
+  : cluster_{cluster}
+  , store_{store}
+  , queue_{queue}
+  , sock_{IPV4}
+  , server_{}
+{
+  if ( cluster_.nodes() == 1 ) {
+    return;
+  }
+
+  sock_.set_reuseaddr();
+  sock_.set_nodelay();
+  sock_.set_send_buffer( Knobs4::NET_SND_BUF );
+  sock_.set_recv_buffer( Knobs4::NET_RCV_BUF );
+  sock_.bind( address );
+  sock_.listen( max( cluster_.nodes(), size_t( 16 ) ) );
+
+  server_ = thread( &BucketStealer::serve, this );
+}
+
+BucketStealer::~BucketStealer( void )
+{
+  if ( server_.joinable() ) {
+    server_.join();
+  }
+}
+
+bool BucketStealer::canSteal( string op )
+{
+  return op == "all" or op == "nth" or op == "first";
+}
+
+void BucketStealer::serve( void )
+{
+  size_t done = 0;
+  while ( done < cluster_.nodes() - 1 ) {
+    auto client = sock_.accept();
+    try {
+      auto str = client.read_all( 1 );
+      if ( client.eof() ) {
+        continue;
+      }
+      switch ( str[0] ) {
+      case RPC::PROGRESS:
+        RPC_Progress( client );
+        break;
+      case RPC::STEAL:
+        RPC_Steal( client );
+        break;
+      case RPC::DONE:
+        done++;
+        break;
+      default:
+        throw runtime_error( "Unknown steal RPC: " + to_string( str[0] ) );
+      }
+    } catch ( const exception & e ) {
+      print_exception( e );
+    }
+  }
+}
+
+void BucketStealer::RPC_Progress( TCPSocket & client )
+{
+  char reply[sizeof( uint64_t ) + 1];
+  // only what steal would actually give, so nodes don't keep asking for
+  // buckets we'll refuse
+  uint64_t queued = queue_.stealable( MIN_QUEUED,
+    [this]( uint16_t bkt ) { return fits( bkt ); } );
+  memcpy( reply, &queued, sizeof( queued ) );
+  reply[sizeof( uint64_t )] = queue_.open();
+  client.write_all( reply, sizeof( reply ) );
+}
+
+/* Buckets we'd sort with an external merge are too big to give away */
+bool BucketStealer::fits( uint16_t bkt )
+{
+  uint64_t len = store_.resident( bkt ) ? store_.size( bkt )
+    : File( cluster_.bucket_path( bkt ), O_RDONLY ).size();
+  return len <= cluster_.bucketMaxSize();
+}
+
+void BucketStealer::RPC_Steal( TCPSocket & client )
+{
+  uint16_t bkt;
+  if ( not queue_.steal( MIN_QUEUED,
+        [this]( uint16_t b ) { return fits( b ); }, bkt ) ) {
+    sendHeader( client, NO_BUCKET, 0 );
+    return;
+  }
+
+  auto t0 = time_now();
+  BucketSorter bs( cluster_, store_, bkt );
+  bs.loadBucket();
+  try {
+    sendHeader( client, bkt, bs.size() );
+    bs.sendUnsorted( client );
+    print( "gave-bucket", timestamp<ms>(), bkt, bs.size(),
+      client.peer_address().to_string(), time_diff<ms>( t0 ) );
+  } catch ( const exception & e ) {
+    // it's no longer queued, so we have to sort it ourselves
+    print( "give-bucket-failed", timestamp<ms>(), bkt, e.what() );
+    bs.sortBucket();
+    bs.saveBucket();
+  }
+}
+
+bool BucketStealer::request( size_t node, RPC rpc, TCPSocket & sock )
+{
+  Address addr = cluster_.addresses()[node];
+  sock = TCPSocket( (IPVersion) addr.domain() );
+  sock.set_nodelay();
+  try {
+    sock.connect( addr );
+  } catch ( const unix_error & e ) {
+    if ( e.code().value() == ECONNREFUSED ) {
+      return false;
+    }
+    throw;
+  }
+  char c = rpc;
+  sock.write_all( &c, 1 );
+  return true;
+}
+
+bool BucketStealer::stealFrom( size_t node )
+{
+  TCPSocket sock;
+  if ( not request( node, STEAL, sock ) ) {
+    return false;
+  }
+
+  uint16_t bkt;
+  uint64_t len;
+  recvHeader( sock, bkt, len );
+  if ( bkt == NO_BUCKET ) {
+    return false;
+  }
+
+  auto t0 = time_now();
+  BucketSorter bs( cluster_, store_, bkt );
+  bs.loadBucket( sock, len );
+  auto t1 = time_now();
+  bs.sortBucket();
+  bs.saveBucket();
+  bs.freeBucket();
+  print( "stole-bucket", timestamp<ms>(), node, bkt, len,
+    time_diff<ms>( t1, t0 ), time_diff<ms>( t1 ) );
+  return true;
+}
+
+size_t BucketStealer::stealBuckets( void )
+{
+  if ( cluster_.nodes() == 1 ) {
+    return 0;
+  }
+
+  auto t0 = time_now();
+  size_t stolen = 0;
+
+  // however we leave, the others wait to hear we're done with them
+  struct DoneGuard
+  {
+    BucketStealer & stealer;
+    ~DoneGuard( void ) { stealer.sendDone(); }
+  } done{*this};
+
+  // nodes that will never have a bucket worth taking, as their queues are
+  // complete and only shrink from here
+  vector<uint8_t> finished( cluster_.nodes(), false );
+  finished[cluster_.myID()] = true;
+
+  while ( true ) {
+    size_t victim = 0;
+    uint64_t most = 0;
+    bool waiting = false;
+    for ( size_t n = 0; n < cluster_.nodes(); n++ ) {
+      if ( finished[n] ) {
+        continue;
+      }
+
+      // a node still in phase one isn't serving yet
+      uint64_t queued;
+      bool open;
+      try {
+        TCPSocket sock;
+        if ( not request( n, PROGRESS, sock ) ) {
+          waiting = true;
+          continue;
+        }
+        string reply = sock.read_all( sizeof( uint64_t ) + 1 );
+        if ( reply.size() != sizeof( uint64_t ) + 1 ) {
+          throw runtime_error( "Truncated progress reply" );
+        }
+        memcpy( &queued, reply.data(), sizeof( queued ) );
+        open = reply[sizeof( uint64_t )];
+      } catch ( const exception & e ) {
+        waiting = true;
+        continue;
+      }
+
+      if ( queued >= MIN_QUEUED and queued > most ) {
+        victim = n;
+        most = queued;
+      } else if ( open ) {
+        waiting = true;
+      } else {
+        finished[n] = true;
+      }
+    }
+
+    if ( most > 0 ) {
+      print( "steal-progress", timestamp<ms>(), victim, most );
+      if ( stealFrom( victim ) ) {
+        stolen++;
+      } else {
+        // someone else got there first, or its sorter did
+        this_thread::sleep_for( chrono::milliseconds( POLL_MS ) );
+      }
+    } else if ( waiting ) {
+      this_thread::sleep_for( chrono::milliseconds( POLL_MS ) );
+    } else {
+      break;
+    }
+  }
+
+  print( "steal-end", timestamp<ms>(), stolen, time_diff<ms>( t0 ) );
+  return stolen;
+}
+
+void BucketStealer::sendDone( void ) noexcept
+{
+  // leaving early (on an error), a node may not be serving yet
+  for ( size_t n = 0; n < cluster_.nodes(); n++ ) {
+    if ( n == cluster_.myID() ) {
+      continue;
+    }
+    auto t0 = time_now();
+    while ( true ) {
+      try {
+        TCPSocket sock;
+        if ( request( n, DONE, sock ) ) {
+          break;
+        }
+      } catch ( const exception & e ) {
+        print_exception( e );
+      }
+      if ( time_diff<ms>( t0 ) >= Knobs4::CONNECT_TIMEOUT * 1000 ) {
+        print( "steal-done-failed", timestamp<ms>(), n );
+        break;
+      }
+      this_thread::sleep_for( chrono::milliseconds( POLL_MS ) );
+    }
+  }
+}
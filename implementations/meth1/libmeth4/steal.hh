@@ -0,0 +1,80 @@
+#ifndef METH4_STEAL_HH
+#define METH4_STEAL_HH
+
+#include <string>
+#include <thread>
+
+#include "address.hh"
+#include "socket.hh"
+
+#include "bucket_queue.hh"
+#include "bucket_store.hh"
+#include "cluster_map.hh"
+#include "meth4_knobs.hh"
+
+/* Lets nodes that have sorted all their own buckets take unsorted buckets
+ * from nodes still sorting theirs (e.g., behind a slow disk), so the slowest
+ * node doesn't set the finish time of phase two.
+ *
+ * During phase two each node serves its progress (buckets still queued) and
+ * hands out queued buckets on its port, one request per connection. Once
+ * done with its own buckets, a node repeatedly asks the others for their
+ * progress and takes a bucket from the one furthest behind, receiving it raw
+ * to sort and save locally. So a stolen bucket's sorted file (and summary)
+ * ends up on the node that stole it. */
+class BucketStealer
+{
+public:
+  enum RPC : int8_t {
+    PROGRESS, // -> <uint64_t stealable, uint8_t still queueing>
+    STEAL,    // -> <uint16_t bucket, uint64_t len, bucket> or no bucket
+    DONE      // won't ask any more of this node
+  };
+
+  static constexpr uint16_t NO_BUCKET = 65535;
+  static constexpr size_t MIN_QUEUED = Knobs4::STEAL_MIN_QUEUED;
+  static constexpr size_t POLL_MS = Knobs4::STEAL_POLL_MS;
+
+private:
+  ClusterMap & cluster_;
+  BucketStore & store_;
+  BucketQueue & queue_;
+  TCPSocket sock_;
+  std::thread server_;
+
+  void serve( void );
+  void RPC_Progress( TCPSocket & client );
+  void RPC_Steal( TCPSocket & client );
+
+  /* Send a request to a node, false if it isn't serving yet */
+  bool request( size_t node, RPC rpc, TCPSocket & sock );
+
+  /* Take and sort a bucket from a node, false if it had none to give */
+  bool stealFrom( size_t node );
+
+  /* Could we give the bucket away? */
+  bool fits( uint16_t bkt );
+
+  /* Tell every other node we won't ask any more of it */
+  void sendDone( void ) noexcept;
+
+public:
+  /* Starts serving requests for the buckets in the queue */
+  BucketStealer( ClusterMap & cluster, BucketStore & store,
+    BucketQueue & queue, Address address );
+  BucketStealer( const BucketStealer & ) = delete;
+  BucketStealer & operator=( const BucketStealer & ) = delete;
+
+  /* Waits for every other node to be done with us */
+  ~BucketStealer( void );
+
+  /* Once our own buckets are sorted, sort buckets taken from other nodes
+   * until none are left worth taking. Returns the number taken. */
+  size_t stealBuckets( void );
+
+  /* Only operations whose sorted buckets stay on the nodes (rather than
+   * being sent to the client, or sorted lazily) can steal buckets */
+  static bool canSteal( std::string op );
+};
+
+#endif /* METH4_STEAL_HH */
@@ -11,8 +11,10 @@ CircularIO::CircularIO( IODevice & io, size_t blocks, int id )
   , bufSize_{blocks * BLOCK}
   , blocks_{blocks-2}
   , start_{0}
+  , offsets_( blocks )
   , reader_{}
   , io_cb_{[]() {}}
+  , skip_cb_{}
   , readPass_{0}
   , id_{id}
 {
@@ -53,6 +55,18 @@ void CircularIO::set_io_drained_cb( function<void(void)> f )
   io_cb_ = f;
 }
 
+/* set the callback to ask how many bytes we can skip reading */
+void CircularIO::set_skip_cb( function<size_t(size_t)> f )
+{
+  skip_cb_ = f;
+}
+
+/* offset in the device that a block starts at */
+size_t CircularIO::block_offset( const char * blk ) const noexcept
+{
+  return offsets_[( blk - buf_ ) / BLOCK];
+}
+
 /* return id of back IODevice */
 int CircularIO::id( void ) const noexcept
 {
@@ -73,16 +87,29 @@ void CircularIO::read_loop( void )
       auto t0 = time_now();
       tdiff_t tread = 0;
       char * wptr_ = buf_;
-      size_t rbytes = 0;
+      size_t rbytes = 0, sbytes = 0;
       while ( true ) {
+        if ( skip_cb_ ) {
+          size_t skip = min( skip_cb_( rbytes ), nbytes - rbytes );
+          rbytes += skip;
+          sbytes += skip;
+          if ( rbytes == nbytes ) {
+            io_cb_();
+            blocks_.send( { nullptr, 0} ); // indicate EOF
+            break;
+          }
+        }
+
         auto t0 = time_now();
         // should only issue disk block size reads when using O_DIRECT
         size_t blkSize = io_.is_odirect()
           ? BLOCK : min( BLOCK, nbytes - rbytes );
-        size_t n = io_.read( wptr_, blkSize );
+        size_t n = skip_cb_ ? io_.pread( wptr_, blkSize, rbytes )
+                            : io_.read( wptr_, blkSize );
         tread += time_diff<ms>( t0 );
 
         if ( n > 0 ) {
+          offsets_[( wptr_ - buf_ ) / BLOCK] = rbytes;
           rbytes += n;
           blocks_.send( {wptr_, n} );
           wptr_ += BLOCK;
@@ -103,6 +130,9 @@ void CircularIO::read_loop( void )
       }
       auto tblocked = time_diff<ms>( t0 );
       print( "circular-read-total", id_, readPass_, rbytes, tread, tblocked );
+      if ( sbytes > 0 ) {
+        print( "circular-read-skipped", id_, readPass_, sbytes );
+      }
     }
   } catch ( const Channel<size_t>::closed_error & e  ) {
     // Allow closing channel to kill thread
@@ -6,6 +6,7 @@
 #include <memory>
 #include <system_error>
 #include <thread>
+#include <vector>
 
 #include "tune_knobs.hh"
 
@@ -32,8 +33,10 @@ private:
   size_t bufSize_;
   Channel<block_ptr> blocks_;
   Channel<size_t> start_;
+  std::vector<size_t> offsets_;
   std::thread reader_;
   std::function<void(void)> io_cb_;
+  std::function<size_t(size_t)> skip_cb_;
 
   /* debug info */
   size_t readPass_;
@@ -57,6 +60,15 @@ public:
   block_ptr next_block( void );
   void set_io_drained_cb( std::function<void(void)> f );
 
+  /* set a callback the reader asks, at each block boundary, how many bytes
+   * from that offset it can skip over (multiple of BLOCK, or through EOF).
+   * Reads are positional once set, so only for devices supporting pread. Must
+   * be set before the first read starts. */
+  void set_skip_cb( std::function<size_t(size_t)> f );
+
+  /* offset in the device that a block returned by next_block starts at */
+  size_t block_offset( const char * blk ) const noexcept;
+
   int id( void ) const noexcept;
 };
 
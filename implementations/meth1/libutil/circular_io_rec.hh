@@ -22,6 +22,8 @@ private:
   const char * pos_;
   size_t recs_;
   size_t rrbytes_;
+  size_t poff_;
+  size_t roff_;
 
 public:
   CircularIORec( IODevice & io, size_t blocks, int id = 0 )
@@ -30,6 +32,8 @@ public:
     , pos_{nullptr}
     , recs_{0}
     , rrbytes_{0}
+    , poff_{0}
+    , roff_{0}
   {};
 
   /* no copy or move */
@@ -45,6 +49,9 @@ public:
 
   size_t rec_count( void ) const noexcept { return recs_; }
 
+  /* offset in the device of the last record returned */
+  size_t rec_offset( void ) const noexcept { return roff_; }
+
   const char * next_record( void )
   {
     // either haven't got first block OR exactly consumed current block
@@ -56,13 +63,16 @@ public:
       pos_ = blk.first;
       bend_ = blk.first + blk.second;
       rrbytes_ += blk.second;
+      poff_ = block_offset( blk.first );
     }
 
     recs_++;
+    roff_ = poff_;
     if ( pos_ + rec_size <= bend_ ) {
       // record within a single block
       const char * p = pos_;
       pos_ += rec_size;
+      poff_ += rec_size;
       return p;
     } else {
       // record cross block boundary
@@ -81,6 +91,7 @@ public:
 
       memcpy( rec_ + partial, pos_, rec_size - partial );
       pos_ += rec_size - partial;
+      poff_ = block_offset( blk.first ) + rec_size - partial;
       return rec_;
     }
   }
@@ -42,6 +42,12 @@ void File::fsync( void )
   SystemCall( "fsync", ::fsync( fd_num() ) );
 }
 
+/* truncate (or extend) file to size given */
+void File::truncate( off_t len )
+{
+  SystemCall( "ftruncate", ::ftruncate( fd_num(), len ) );
+}
+
 /* file size */
 off_t File::size( void ) const
 {
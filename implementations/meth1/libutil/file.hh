@@ -19,6 +19,9 @@ public:
   /* force file contents to disk */
   void fsync( void );
 
+  /* truncate (or extend) file to size given */
+  void truncate( off_t len );
+
   /* file size */
   off_t size( void ) const;
 };
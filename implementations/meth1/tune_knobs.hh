@@ -52,6 +52,25 @@ namespace Knobs {
   /* Use parallel sort? */
   static constexpr bool PARALLEL_SORT = true;
 
+  /* Adaptive indexing: each read leaves behind the records bounding it (and
+   * every ADAPTIVE_INDEX_STRIDE'th record within it), so later reads seek from
+   * the nearest known position and bound their scans from above. */
+  static constexpr bool ADAPTIVE_INDEX = true;
+  static constexpr uint64_t ADAPTIVE_INDEX_STRIDE = 1024 * 64;
+  static constexpr uint64_t ADAPTIVE_INDEX_BOUNDS = 1024 * 256; // ~40MB
+
+  /* Records of past reads to also keep (0 for none), so later reads falling
+   * within one are served from memory without a scan. */
+  static constexpr uint64_t ADAPTIVE_INDEX_PIECES = 0;
+
+  /* Keep a min/max key per zone of each file (zone maps), built on the first
+   * full scan, so later scans skip reading zones holding no key they want? */
+  static constexpr bool ZONE_MAPS = true;
+
+  /* Save zone maps next to their file (as `<file>.zones`) so they survive a
+   * restart? */
+  static constexpr bool ZONE_MAPS_PERSIST = false;
+
   /* Use hand-rolled memcmp? */
   static constexpr bool USE_OWN_MEMCMP = true;
 
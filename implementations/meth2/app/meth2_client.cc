@@ -2,6 +2,7 @@
 #include <sys/types.h>
 
 #include <cstdlib>
+#include <cstring>
 #include <chrono>
 #include <iostream>
 #include <sstream>
@@ -20,6 +21,15 @@ File query_file( string out_dir, unsigned int query, string type )
   return {out, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR};
 }
 
+/* Key from (up to 10 bytes of) hex, padded with zeros */
+void parse_key( string hex, uint8_t * key )
+{
+  memset( key, 0, Rec::KEY_LEN );
+  for ( size_t i = 0; i < Rec::KEY_LEN and 2 * i + 1 < hex.size(); i++ ) {
+    key[i] = stoul( hex.substr( 2 * i, 2 ), nullptr, 16 );
+  }
+}
+
 void run_cmd( Cluster & c, string out_dir, string cmd, uint64_t read_ahead )
 {
   if ( cmd == "first" ) {
@@ -44,6 +54,56 @@ void run_cmd( Cluster & c, string out_dir, string cmd, uint64_t read_ahead )
     auto dur = chrono::duration_cast<chrono::milliseconds>( end - start ).count();
     cout << "cmd-chunk, 0, " << dur << endl;
 
+  } else if ( cmd.compare( 0, 5, "keys-" ) == 0 ) {
+    // keys-<lo>-<hi>-<limit>, keys in hex
+    size_t i = cmd.find( '-', 5 ), j = cmd.find( '-', i + 1 );
+    uint8_t lo[Rec::KEY_LEN], hi[Rec::KEY_LEN];
+    parse_key( cmd.substr( 5, i - 5 ), lo );
+    parse_key( cmd.substr( i + 1, j - i - 1 ), hi );
+    auto lim = atol( cmd.substr( j + 1 ).c_str() );
+
+    auto start = chrono::high_resolution_clock::now();
+    auto recs = c.ReadRange( lo, hi, lim );
+    auto end = chrono::high_resolution_clock::now();
+    auto dur = chrono::duration_cast<chrono::milliseconds>( end - start ).count();
+    if ( recs.size() > 0 ) {
+      cout << "keys-first, " << recs.front() << endl;
+      cout << "keys-last, " << recs.back() << endl;
+    }
+    cout << "cmd-keys, 0, " << dur << ", " << recs.size() << endl;
+
+  } else if ( cmd.compare( 0, 4, "get-" ) == 0 ) {
+    // get-<n>, n scattered positions (multiplicative hash of 0..n-1)
+    uint64_t n = atol( cmd.substr( 4 ).c_str() );
+    uint64_t size = c.Size();
+    vector<uint64_t> pos;
+    for ( uint64_t i = 0; i < n and size > 0; i++ ) {
+      pos.push_back( ( i * 2654435761 ) % size );
+    }
+
+    auto start = chrono::high_resolution_clock::now();
+    auto recs = c.Get( pos );
+    auto end = chrono::high_resolution_clock::now();
+    auto dur = chrono::duration_cast<chrono::milliseconds>( end - start ).count();
+
+    File out = query_file( out_dir, 0, "get" );
+    for ( auto const & r : recs ) {
+      r.write( out );
+    }
+    cout << "cmd-get, 0, " << dur << ", " << recs.size() << endl;
+
+  } else if ( cmd.compare( 0, 4, "add-" ) == 0 ) {
+    // add-<node>-<file>, node by its position in the node list
+    size_t i = cmd.find( '-', 4 );
+    auto node = atol( cmd.substr( 4, i - 4 ).c_str() );
+    string file = cmd.substr( i + 1 );
+
+    auto start = chrono::high_resolution_clock::now();
+    c.AddFile( node, file );
+    auto end = chrono::high_resolution_clock::now();
+    auto dur = chrono::duration_cast<chrono::milliseconds>( end - start ).count();
+    cout << "cmd-add, 0, " << dur << endl;
+
   } else if ( cmd.find_first_of( "chunk-" ) == 0 ) {
     size_t i = cmd.find_last_of( '-' );
     auto siz = atol( cmd.substr( i + 1 ).c_str() );
@@ -24,20 +24,36 @@ bool to_bool( std::string str )
   return b;
 }
 
-int run( const char * port, vector<string> files)
+int run( const char * port, vector<string> files, bool global = false,
+         uint32_t id = 0, vector<Address> peers = {} )
 {
   Node node{files, port};
+  if ( global ) {
+    node.Globalize( id, peers );
+  }
   node.Initialize();
   node.Run();
 
   return EXIT_SUCCESS;
 }
 
+vector<Address> to_peers( string str )
+{
+  vector<Address> peers;
+  istringstream is( str );
+  string peer;
+  while ( getline( is, peer, ',' ) ) {
+    peers.emplace_back( peer );
+  }
+  return peers;
+}
+
 void check_usage( const int argc, const char * const argv[] )
 {
-  if ( argc < 3 ) {
+  bool global = argc > 1 and string( argv[1] ) == "-g";
+  if ( argc < 3 or ( global and argc < 6 ) ) {
     throw runtime_error( "Usage: " + string( argv[0] ) +
-                         " [port] [file...]" );
+                         " [-g [id] [peer,peer,...]] [port] [file...]" );
   }
 }
 
@@ -45,7 +61,12 @@ int main( int argc, char * argv[] )
 {
   try {
     check_usage( argc, argv );
-    run( argv[1], { argv+2, argv+argc } );
+    if ( string( argv[1] ) == "-g" ) {
+      run( argv[4], { argv+5, argv+argc }, true, stoul( argv[2] ),
+           to_peers( argv[3] ) );
+    } else {
+      run( argv[1], { argv+2, argv+argc } );
+    }
   } catch ( const exception & e ) {
     print_exception( e );
     return EXIT_FAILURE;
@@ -16,13 +16,15 @@ using namespace std;
 namespace meth2
 {
 
-Circular_AIO::Circular_AIO(vector<File> &dev, vector<RecordLoc> &recs_)
+Circular_AIO::Circular_AIO(vector<File> &dev, vector<RecordLoc> &recs_,
+			   ValueCache *cache)
     : requestExit(false),
       cmd(),
       result(),
       threads(),
       io_(dev),
       recs_(recs_),
+      cache_(cache),
       out(nullptr),
       posMutex(),
       pos(0),
@@ -98,7 +100,11 @@ Circular_AIO::ioProcess()
 	uint8_t buf[Rec::VAL_LEN];
 	RecordLoc &r = recs_[start+off];
 
-	io_[r.disk()].pread_all((char *)&buf, Rec::VAL_LEN, r.loc());
+	if (cache_) {
+	    cache_->read(io_[r.disk()], r.disk(), r.loc(), buf);
+	} else {
+	    io_[r.disk()].pread_all((char *)&buf, Rec::VAL_LEN, r.loc());
+	}
 
 	(*out)[off] = std::move(Node::RR(r, buf));
     }
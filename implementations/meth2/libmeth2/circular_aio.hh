@@ -11,7 +11,8 @@ public:
 	void *buf;
 	uint64_t len;
     };
-    Circular_AIO(std::vector<File> &dev, std::vector<RecordLoc> &recs_);
+    Circular_AIO(std::vector<File> &dev, std::vector<RecordLoc> &recs_,
+		 ValueCache *cache = nullptr);
     ~Circular_AIO();
     void begin(Node::RecV *buf, uint64_t start, uint64_t size);
     void wait();
@@ -26,6 +27,8 @@ private:
     std::vector<File> &io_;
     // Sorted Records
     std::vector<RecordLoc> &recs_;
+    // Values read before (optional)
+    ValueCache *cache_;
     // Output
     Node::RecV *out;
     std::mutex posMutex;
@@ -1,3 +1,4 @@
+#include <cstring>
 #include <iostream>
 
 #include "buffered_io.hh"
@@ -50,6 +51,35 @@ uint64_t Client::recvRead( void )
   return nrecs;
 }
 
+void Client::sendReadRange( const uint8_t * lo, uint64_t skip,
+                            const uint8_t * hi, uint64_t limit )
+{
+  rpcPos_ = 0;
+
+  char data[1 + 2 * Rec::KEY_LEN + 2 * sizeof( uint64_t )];
+  data[0] = 6;
+  memcpy( data + 1, lo, Rec::KEY_LEN );
+  memcpy( data + 1 + Rec::KEY_LEN, hi, Rec::KEY_LEN );
+  *reinterpret_cast<uint64_t *>( data + 1 + 2 * Rec::KEY_LEN ) = limit;
+  *reinterpret_cast<uint64_t *>( data + 1 + 2 * Rec::KEY_LEN
+                                 + sizeof( uint64_t ) ) = skip;
+  sock_.io().write_all( data, sizeof( data ) );
+}
+
+void Client::sendGet( const vector<uint64_t> & pos )
+{
+  rpcPos_ = 0;
+
+  char data[1 + sizeof( uint64_t )];
+  data[0] = 7;
+  *reinterpret_cast<uint64_t *>( data + 1 ) = pos.size();
+  sock_.io().write_all( data, sizeof( data ) );
+  if ( pos.size() > 0 ) {
+    sock_.io().write_all( reinterpret_cast<const char *>( pos.data() ),
+                          pos.size() * sizeof( uint64_t ) );
+  }
+}
+
 RecordPtr Client::readRecord( void )
 {
   auto recStr = sock_.read_buf_all( Rec::SIZE ).first;
@@ -112,3 +142,81 @@ uint64_t Client::recvSize( void )
   return size;
 }
 
+
+void Client::sendRank( const uint8_t * key )
+{
+  char data[1 + Rec::KEY_LEN];
+  data[0] = 4;
+  memcpy( data + 1, key, Rec::KEY_LEN );
+  sock_.io().write_all( data, sizeof( data ) );
+}
+
+void Client::recvRank( uint64_t & below, uint64_t & upto )
+{
+  auto rankStr = sock_.read_buf_all( 2 * sizeof( uint64_t ) ).first;
+  below = *reinterpret_cast<const uint64_t *>( rankStr );
+  upto = *( reinterpret_cast<const uint64_t *>( rankStr ) + 1 );
+}
+
+void Client::sendSelect( uint64_t i )
+{
+  char data[1 + sizeof( uint64_t )];
+  data[0] = 5;
+  *reinterpret_cast<uint64_t *>( data + 1 ) = i;
+  sock_.io().write_all( data, sizeof( data ) );
+}
+
+RecordLoc Client::recvSelect( void )
+{
+  auto keyStr = sock_.read_buf_all( Rec::KEY_LEN ).first;
+  return { reinterpret_cast<const uint8_t *>( keyStr ) };
+}
+
+void Client::sendAddFile( const string & file )
+{
+  char data[1 + sizeof( uint64_t )];
+  data[0] = 8;
+  *reinterpret_cast<uint64_t *>( data + 1 ) = file.size();
+  sock_.io().write_all( data, sizeof( data ) );
+  sock_.io().write_all( file );
+}
+
+bool Client::recvAddFile( void )
+{
+  return sock_.read_buf_all( 1 ).first[0] != 0;
+}
+
+void Client::sendAddStatus( const string & file )
+{
+  char data[1 + sizeof( uint64_t )];
+  data[0] = 9;
+  *reinterpret_cast<uint64_t *>( data + 1 ) = file.size();
+  sock_.io().write_all( data, sizeof( data ) );
+  sock_.io().write_all( file );
+}
+
+uint8_t Client::recvAddStatus( string & error )
+{
+  auto str = sock_.read_buf_all( 1 + sizeof( uint64_t ) ).first;
+  uint8_t state = str[0];
+  uint64_t len = *reinterpret_cast<const uint64_t *>( str + 1 );
+  if ( len > 0 ) {
+    error.assign( sock_.read_buf_all( len ).first, len );
+  } else {
+    error.clear();
+  }
+  return state;
+}
+
+void Client::sendInfo( void )
+{
+  int8_t rpc = 3;
+  sock_.io().write_all( (char *)&rpc, 1 );
+}
+
+void Client::recvInfo( bool & global, uint32_t & id )
+{
+  auto infoStr = sock_.read_buf_all( 1 + sizeof( uint32_t ) ).first;
+  global = infoStr[0] != 0;
+  id = *reinterpret_cast<const uint32_t *>( infoStr + 1 );
+}
@@ -1,6 +1,9 @@
 #ifndef METH2_CLIENT2_HH
 #define METH2_CLIENT2_HH
 
+#include <string>
+#include <vector>
+
 #include "address.hh"
 #include "buffered_io.hh"
 #include "socket.hh"
@@ -37,6 +40,14 @@ public:
   uint64_t recvRead( void );
   RecordPtr readRecord( void );
 
+  /* Perform a key-range read of keys in [lo, hi), skipping the first skip of
+   * them. Receive with recvRead. */
+  void sendReadRange( const uint8_t * lo, uint64_t skip, const uint8_t * hi,
+                      uint64_t limit );
+
+  /* Read the records at a batch of positions. Receive with recvRead. */
+  void sendGet( const std::vector<uint64_t> & pos );
+
   /* Perform an index read. */
   void sendIRead( uint64_t pos, uint64_t size );
   uint64_t recvIRead( void );
@@ -45,6 +56,27 @@ public:
   /* Return the number of records available at this server */
   void sendSize( void );
   uint64_t recvSize( void );
+
+  /* Number of records at the server below, and at or below, a key */
+  void sendRank( const uint8_t * key );
+  void recvRank( uint64_t & below, uint64_t & upto );
+
+  /* Key of the i'th record at the server */
+  void sendSelect( uint64_t i );
+  RecordLoc recvSelect( void );
+
+  /* Have the server index (and then serve) a new data file of its own */
+  void sendAddFile( const std::string & file );
+  bool recvAddFile( void );
+
+  /* How adding a file at the server has gone (a Node::AddState), and why, if
+   * it failed */
+  void sendAddStatus( const std::string & file );
+  uint8_t recvAddStatus( std::string & error );
+
+  /* Is the server part of a global index, and if so, with what node ID */
+  void sendInfo( void );
+  void recvInfo( bool & global, uint32_t & id );
 };
 }
 
@@ -1,5 +1,10 @@
 
+#include <algorithm>
 #include <cassert>
+#include <cstring>
+#include <chrono>
+#include <numeric>
+#include <thread>
 #include <vector>
 
 #include "buffered_io.hh"
@@ -11,6 +16,7 @@
 #include "client.hh"
 #include "cluster.hh"
 #include "exception.hh"
+#include "node.hh"
 #include "priority_queue.hh"
 #include "remote_file.hh"
 
@@ -20,10 +26,50 @@ using namespace meth2;
 Cluster::Cluster( vector<Address> nodes, uint64_t chunkSize )
   : clients_{}
   , chunkSize_{chunkSize}
+  , global_{false}
+  , sizes_{}
+  , offsets_{}
+  , splitters_{}
+  , splitSize_{0}
 {
   for ( auto & n : nodes ) {
     clients_.push_back( n );
   }
+
+  // are the nodes serving one global index between them?
+  for ( auto & c : clients_ ) {
+    c.sendInfo();
+  }
+  vector<uint32_t> ids;
+  uint32_t nglobal = 0;
+  for ( auto & c : clients_ ) {
+    bool global;
+    uint32_t id;
+    c.recvInfo( global, id );
+    nglobal += global ? 1 : 0;
+    ids.push_back( id );
+  }
+  if ( nglobal == 0 ) {
+    return;
+  } else if ( nglobal != clients_.size() ) {
+    throw runtime_error( "Mix of global and local index nodes" );
+  }
+
+  global_ = true;
+  for ( auto & c : clients_ ) {
+    sizes_.push_back( Size( c ) );
+  }
+  offsets_.assign( clients_.size(), 0 );
+  for ( uint64_t i = 0; i < clients_.size(); i++ ) {
+    if ( ids[i] >= clients_.size() ) {
+      throw runtime_error( "Node ID outside cluster" );
+    }
+    for ( uint64_t j = 0; j < clients_.size(); j++ ) {
+      if ( ids[j] < ids[i] ) {
+        offsets_[i] += sizes_[j];
+      }
+    }
+  }
 }
 
 Cluster::~Cluster()
@@ -44,121 +90,29 @@ uint64_t Cluster::Size( void )
   return size;
 }
 
-uint64_t
-GetLargest(std::vector<Cluster::NodeSplit> &ns)
-{
-    uint64_t n = 0;
-
-    for (uint64_t i = 0; i < ns.size(); i++) {
-	if (ns[n].key.compare(ns[i].key) <= 0) {
-	    n = i;
-	}
-    }
-
-    return n;
-}
-
-uint64_t
-GetSmallest(std::vector<Cluster::NodeSplit> &ns)
-{
-    uint64_t n = 0;
-
-    for (uint64_t i = 0; i < ns.size(); i++) {
-	if (ns[n].key.compare(ns[i].key) > 0) {
-	    n = i;
-	}
-    }
-
-    return n;
-}
-
-bool
-SplitDone(std::vector<Cluster::NodeSplit> &ns)
-{
-    for (uint64_t i = 0; i < ns.size(); i++) {
-	for (uint64_t j = 0; j < ns.size(); j++) {
-	    //cout << i << "IJ" << j << endl;
-	    if (ns[i].key.compare(ns[j].nextKey) > 0)
-		return false;
-	}
-    }
-
-    return true;
-}
-
+/*
+ * Find where the first n records (in sorted order) end on each node.
+ */
 std::vector<Cluster::NodeSplit>
 Cluster::GetSplit(uint64_t n)
 {
-    uint64_t i;
-    std::vector<NodeSplit> ns;
+    std::vector<NodeSplit> ns(clients_.size());
 
-    //auto rmid = IRead(clients_[0], Size(clients_[0]) / 2, 1);
-    //auto rsrch = IBSearch(clients_[0], rmid[0]);
+    for (auto &c : clients_) {
+	c.sendSize();
+    }
+    vector<uint64_t> sizes;
+    for (auto &c : clients_) {
+	sizes.push_back(c.recvSize());
+    }
 
-    for (i = 0; i < clients_.size(); i++) {
-	ns.emplace_back();
+    vector<uint64_t> split = move(Splits(sizes, {n}).front());
+    for (uint64_t i = 0; i < clients_.size(); i++) {
 	ns[i].clientNo = i;
-	ns[i].size = Size(clients_[i]);
-	ns[i].start = 0;
-	ns[i].end = n - 1;
-	ns[i].n = n / clients_.size();
-    }
-    // Adjust ns[0].n to account for rounding
-    ns[0].n += n - (ns[0].n * clients_.size());
-
-    for (i = 0; i < clients_.size(); i++) {
-	// Read n and n+1
-	vector<RecordLoc> rl = IRead(clients_[i], ns[i].n, 2);
-	ns[i].key = rl[0];
-	ns[i].nextKey = rl[1];
-    }
-
-    /*for (auto &n : ns)
-	n.dump();*/
-
-    while (!SplitDone(ns)) {
-	uint64_t largest, smallest, step;
-	uint64_t newStart, newEnd;
-
-	largest = GetLargest(ns);
-	smallest = GetSmallest(ns);
-
-	newStart = IBSearch(clients_[ns[largest].clientNo],
-			    ns[smallest].key);
-	newEnd = ns[largest].n;
-	if (newStart > ns[largest].start)
-	    ns[largest].start = newStart;
-	if (newEnd < ns[largest].end)
-	    ns[largest].end = newEnd;
-
-	newStart = ns[smallest].n;
-	newEnd = IBSearch(clients_[ns[smallest].clientNo],
-			  ns[largest].key);
-	if (newStart > ns[smallest].start)
-	    ns[smallest].start = newStart;
-	if (newEnd < ns[smallest].end)
-	    ns[smallest].end = newEnd;
-
-	uint64_t largestStep = ns[largest].end - ns[largest].start;
-	uint64_t smallestStep = ns[smallest].end - ns[smallest].start;
-	step = (largestStep > smallestStep) ? smallestStep : largestStep;
-    
-	step /= 2;
-	if (step == 0)
-	    step = 1;
-
-	ns[largest].n -= step;
-	ns[smallest].n += step;
-
-	for (i = 0; i < clients_.size(); i++) {
-	    // Read n and n+1
-	    vector<RecordLoc> rl = IRead(clients_[i], ns[i].n, 2);
-	    ns[i].key = rl[0];
-	    ns[i].nextKey = rl[1];
-	}
-
-	/*for (auto &n : ns)
-	    n.dump();*/
+	ns[i].size = sizes[i];
+	ns[i].start = split[i];
+	ns[i].end = split[i];
+	ns[i].n = split[i];
     }
 
     //for (auto &n : ns)
@@ -167,32 +121,145 @@ Cluster::GetSplit(uint64_t n)
     return ns;
 }
 
-uint64_t
-Cluster::IBSearch( Client &c, RecordLoc &rl )
+/*
+ * Find where the first n records (in sorted order) end on each node, for each
+ * n of a batch. We keep a window [start, end) on each node known to hold its
+ * split point, and narrow them all at once: SELECT the middle key of each
+ * window, take their median (weighted by window size) as a pivot, and RANK it
+ * on every node. At least half the window weight is halved each round, so we
+ * need O(log N) rounds of two batched round trips each. Every n of the batch
+ * narrows in the same rounds, so a batch takes no more of them than one n.
+ */
+vector<vector<uint64_t>> Cluster::Splits( const vector<uint64_t> & sizes,
+                                          const vector<uint64_t> & targets )
 {
-    vector<RecordLoc> tmp;
-    uint64_t start = 0;
-    uint64_t end = Size(c);
-    uint64_t pos = end / 2;
-
-    //cout << "IBSearch" << endl;
-    while (start < end) {
-	//cout << start << ", " << end << ", " << pos << endl;
-	tmp = IRead(c, pos, 1);
-	int val = tmp[0].compare(rl);
-	if (val > 0) {
-	    end = pos;
-	    pos = (start + end) / 2;
-	} else if (val < 0) {
-	    start = pos + 1;
-	    pos = (start + end) / 2;
-	} else {
-	    return pos;
-	}
-    }
-    //cout << "IBSearch" << endl;
-
-    return pos;
+  static constexpr uint64_t PIPELINE = Knobs::GET_PIPELINE;
+
+  struct Search
+  {
+    uint64_t n;
+    vector<uint64_t> start;
+    vector<uint64_t> end;
+    vector<RecordLoc> keys;
+    bool done;
+  };
+
+  uint64_t nodes = clients_.size();
+  uint64_t total = accumulate( sizes.begin(), sizes.end(), uint64_t( 0 ) );
+  vector<vector<uint64_t>> splits( targets.size() );
+  vector<Search> ss;
+  vector<uint64_t> active;
+  for ( uint64_t t = 0; t < targets.size(); t++ ) {
+    ss.push_back( {min( targets[t], total ), vector<uint64_t>( nodes, 0 ),
+                   sizes, vector<RecordLoc>( nodes ), false} );
+    active.push_back( t );
+  }
+
+  vector<uint64_t> cands;
+  vector<uint64_t> below( nodes ), upto( nodes );
+  while ( not active.empty() ) {
+    // drop the searches that have found their split
+    vector<uint64_t> next;
+    for ( auto t : active ) {
+      Search & s = ss[t];
+      uint64_t lo = accumulate( s.start.begin(), s.start.end(), uint64_t( 0 ) );
+      uint64_t hi = accumulate( s.end.begin(), s.end.end(), uint64_t( 0 ) );
+      if ( s.done ) {
+        continue;
+      } else if ( lo == s.n ) {
+        splits[t] = s.start;
+      } else if ( hi == s.n ) {
+        splits[t] = s.end;
+      } else {
+        next.push_back( t );
+      }
+    }
+    active.swap( next );
+
+    for ( uint64_t i = 0; i < active.size(); i += PIPELINE ) {
+      auto first = active.begin() + i;
+      auto last = active.begin() + min( active.size(), i + PIPELINE );
+
+      // candidate pivots
+      for ( auto t = first; t != last; t++ ) {
+        Search & s = ss[*t];
+        for ( uint64_t n = 0; n < nodes; n++ ) {
+          if ( s.start[n] < s.end[n] ) {
+            clients_[n].sendSelect( ( s.start[n] + s.end[n] ) / 2 );
+          }
+        }
+      }
+      for ( auto t = first; t != last; t++ ) {
+        Search & s = ss[*t];
+        for ( uint64_t n = 0; n < nodes; n++ ) {
+          if ( s.start[n] < s.end[n] ) {
+            s.keys[n] = clients_[n].recvSelect();
+          }
+        }
+      }
+
+      // weighted median, ranked on every node
+      for ( auto t = first; t != last; t++ ) {
+        Search & s = ss[*t];
+        cands.clear();
+        uint64_t weight = 0;
+        for ( uint64_t n = 0; n < nodes; n++ ) {
+          if ( s.start[n] < s.end[n] ) {
+            cands.push_back( n );
+            weight += s.end[n] - s.start[n];
+          }
+        }
+        sort( cands.begin(), cands.end(), [&s]( uint64_t a, uint64_t b ) {
+          return memcmp( s.keys[a].key(), s.keys[b].key(), Rec::KEY_LEN ) < 0;
+        } );
+        uint64_t acc = 0, pivot = cands.back();
+        for ( auto n : cands ) {
+          acc += s.end[n] - s.start[n];
+          if ( acc * 2 >= weight ) {
+            pivot = n;
+            break;
+          }
+        }
+        for ( auto & c : clients_ ) {
+          c.sendRank( s.keys[pivot].key() );
+        }
+      }
+
+      for ( auto t = first; t != last; t++ ) {
+        Search & s = ss[*t];
+        uint64_t sb = 0, su = 0;
+        for ( uint64_t n = 0; n < nodes; n++ ) {
+          clients_[n].recvRank( below[n], upto[n] );
+          sb += below[n];
+          su += upto[n];
+        }
+
+        if ( sb > s.n ) {
+          // split falls below the pivot
+          for ( uint64_t n = 0; n < nodes; n++ ) {
+            s.end[n] = max( s.start[n], min( s.end[n], below[n] ) );
+          }
+        } else if ( su <= s.n ) {
+          // split falls after the pivot
+          for ( uint64_t n = 0; n < nodes; n++ ) {
+            s.start[n] = min( s.end[n], max( s.start[n], upto[n] ) );
+          }
+        } else {
+          // split falls among records equal to the pivot, share them out
+          uint64_t rem = s.n - sb;
+          splits[*t].resize( nodes );
+          for ( uint64_t n = 0; n < nodes; n++ ) {
+            uint64_t take = min( rem, upto[n] - below[n] );
+            splits[*t][n] = below[n] + take;
+            rem -= take;
+          }
+          s.done = true;
+        }
+      }
+    }
+  }
+
+  return splits;
 }
 
 Record Cluster::ReadFirst( void )
@@ -215,9 +282,46 @@ Record Cluster::ReadFirst( void )
   return min;
 }
 
+void Cluster::GlobalRead( uint64_t pos, uint64_t len )
+{
+  uint64_t size = 0;
+  for ( auto s : sizes_ ) {
+    size += s;
+  }
+  uint64_t end = min( size, pos + len );
+
+  // positions map straight to nodes, so no merging, just a round trip to the
+  // nodes holding each chunk
+  for ( uint64_t i = pos; i < end; i += chunkSize_ ) {
+    uint64_t cend = min( end, i + chunkSize_ );
+    vector<uint64_t> reading;
+    for ( uint64_t n = 0; n < clients_.size(); n++ ) {
+      uint64_t nstart = offsets_[n], nend = offsets_[n] + sizes_[n];
+      if ( nstart < cend and i < nend ) {
+        uint64_t from = max( i, nstart );
+        clients_[n].sendRead( from - nstart, min( cend, nend ) - from );
+        reading.push_back( n );
+      }
+    }
+
+    // receive in global order
+    sort( reading.begin(), reading.end(), [this]( uint64_t a, uint64_t b ) {
+      return offsets_[a] < offsets_[b];
+    } );
+    for ( auto n : reading ) {
+      auto nrecs = clients_[n].recvRead();
+      for ( uint64_t j = 0; j < nrecs; j++ ) {
+        clients_[n].readRecord();
+      }
+    }
+  }
+}
+
 void Cluster::Read( uint64_t pos, uint64_t len )
 {
-  if ( clients_.size() == 1 ) {
+  if ( global_ ) {
+    GlobalRead( pos, len );
+  } else if ( clients_.size() == 1 ) {
     // optimize for 1 node
     auto & c = clients_.front();
     uint64_t size = Size();
@@ -281,6 +385,285 @@ void Cluster::Read( uint64_t pos, uint64_t len )
   }
 }
 
+vector<Record> Cluster::ReadRange( const uint8_t * lo, const uint8_t * hi,
+                                   uint64_t limit )
+{
+  struct Tagged
+  {
+    Record rec;
+    uint64_t node;
+
+    bool operator<( const Tagged & b ) const { return rec < b.rec; }
+  };
+
+  // each node returns its smallest records in range, so the smallest of them
+  // all are the smallest overall. We page through a chunk at a time (no more
+  // than a node returns at once), each node resuming from the last key we
+  // took from it, skipping the records with that key we already have (so
+  // duplicates across a page boundary survive).
+  uint64_t nodes = clients_.size();
+  uint64_t page = min( max( chunkSize_, uint64_t( 1 ) ),
+                       Knobs::RANGE_MAX_RECORDS );
+  vector<string> from( nodes, string( (const char *) lo, Rec::KEY_LEN ) );
+  vector<uint64_t> skip( nodes, 0 );
+  vector<bool> done( nodes, false );
+  vector<uint64_t> got( nodes ), took( nodes );
+  vector<Record> out;
+
+  while ( out.size() < limit and count( done.begin(), done.end(), false ) ) {
+    uint64_t n = min( limit - out.size(), page );
+    for ( uint64_t i = 0; i < nodes; i++ ) {
+      if ( not done[i] ) {
+        clients_[i].sendReadRange( (const uint8_t *) from[i].data(), skip[i],
+                                   hi, n );
+      }
+    }
+
+    vector<Tagged> recs;
+    for ( uint64_t i = 0; i < nodes; i++ ) {
+      got[i] = took[i] = 0;
+      if ( done[i] ) {
+        continue;
+      }
+      got[i] = clients_[i].recvRead();
+      size_t mid = recs.size();
+      for ( uint64_t j = 0; j < got[i]; j++ ) {
+        recs.push_back( {Record( clients_[i].readRecord() ), i} );
+      }
+      inplace_merge( recs.begin(), recs.begin() + mid, recs.end() );
+    }
+
+    uint64_t take = min( n, uint64_t( recs.size() ) );
+    for ( uint64_t j = 0; j < take; j++ ) {
+      Tagged & t = recs[j];
+      if ( memcmp( t.rec.key(), from[t.node].data(), Rec::KEY_LEN ) == 0 ) {
+        skip[t.node]++;
+      } else {
+        from[t.node].assign( (const char *) t.rec.key(), Rec::KEY_LEN );
+        skip[t.node] = 1;
+      }
+      took[t.node]++;
+      out.push_back( move( t.rec ) );
+    }
+
+    // a node is done once it ran out within this page and we took it all
+    for ( uint64_t i = 0; i < nodes; i++ ) {
+      if ( got[i] < n and took[i] == got[i] ) {
+        done[i] = true;
+      }
+    }
+  }
+
+  return out;
+}
+
+vector<Record> Cluster::Get( const vector<uint64_t> & positions )
+{
+  uint64_t size = global_ ? accumulate( sizes_.begin(), sizes_.end(), uint64_t( 0 ) )
+                          : Size();
+  for ( auto p : positions ) {
+    if ( p >= size ) {
+      throw runtime_error( "Get past end: " + to_string( p ) );
+    }
+  }
+
+  // resolve each position to a node, and a position on it
+  vector<vector<uint64_t>> local( clients_.size() );
+  vector<vector<uint64_t>> slot( clients_.size() );
+  if ( global_ ) {
+    for ( uint64_t i = 0; i < positions.size(); i++ ) {
+      for ( uint64_t n = 0; n < clients_.size(); n++ ) {
+        if ( positions[i] >= offsets_[n]
+            and positions[i] - offsets_[n] < sizes_[n] ) {
+          local[n].push_back( positions[i] - offsets_[n] );
+          slot[n].push_back( i );
+          break;
+        }
+      }
+    }
+  } else if ( clients_.size() == 1 ) {
+    local[0] = positions;
+    slot[0].resize( positions.size() );
+    iota( slot[0].begin(), slot[0].end(), 0 );
+  } else {
+    // nodes gaining files move the splits
+    if ( size != splitSize_ ) {
+      splitters_.clear();
+      splitSize_ = size;
+    }
+    Resolve( positions, size, local, slot );
+  }
+
+  // one batched request per node, which they serve in parallel
+  for ( uint64_t n = 0; n < clients_.size(); n++ ) {
+    if ( not local[n].empty() ) {
+      clients_[n].sendGet( local[n] );
+    }
+  }
+  vector<Record> recs( positions.size() );
+  for ( uint64_t n = 0; n < clients_.size(); n++ ) {
+    if ( local[n].empty() ) {
+      continue;
+    }
+    uint64_t nrecs = clients_[n].recvRead();
+    if ( nrecs != local[n].size() ) {
+      throw runtime_error( "Short get reply" );
+    }
+    for ( uint64_t j = 0; j < nrecs; j++ ) {
+      recs[slot[n][j]].copy( clients_[n].readRecord() );
+    }
+  }
+
+  return recs;
+}
+
+void Cluster::AddFile( uint64_t node, string file )
+{
+  if ( node >= clients_.size() ) {
+    throw runtime_error( "No such node: " + to_string( node ) );
+  }
+  Client & c = clients_[node];
+
+  // a refusal is recorded in the status too, along with why
+  c.sendAddFile( file );
+  c.recvAddFile();
+
+  // the node indexes in the background, so poll until it's done
+  while ( true ) {
+    string error;
+    c.sendAddStatus( file );
+    switch ( c.recvAddStatus( error ) ) {
+    case Node::ADD_INDEXED:
+      return;
+    case Node::ADD_PENDING:
+      this_thread::sleep_for( chrono::milliseconds( Knobs::ADD_POLL_MS ) );
+      break;
+    default:
+      throw runtime_error( "Adding " + file + " to node " + to_string( node )
+                           + " failed: " + error );
+    }
+  }
+}
+
+/*
+ * Resolve positions to nodes without a global index. Positions fall in blocks
+ * between splitters, and the nodes' records in a block are just those between
+ * their splits at either end. So we find the splits around every block holding
+ * a position in one batch, fetch the index entries in the blocks from each
+ * node (pipelined), and merge each block, putting ties in node order as
+ * Splits does.
+ */
+void Cluster::Resolve( const vector<uint64_t> & positions, uint64_t size,
+                       vector<vector<uint64_t>> & local,
+                       vector<vector<uint64_t>> & slot )
+{
+  static constexpr uint64_t STRIDE = Knobs::GET_SPLITTER_STRIDE;
+  static constexpr uint64_t PIPELINE = Knobs::GET_PIPELINE;
+
+  struct Entry
+  {
+    RecordLoc rec;
+    uint64_t node;
+    uint64_t pos;
+  };
+
+  vector<uint64_t> order( positions.size() );
+  iota( order.begin(), order.end(), 0 );
+  sort( order.begin(), order.end(), [&positions]( uint64_t a, uint64_t b ) {
+    return positions[a] < positions[b];
+  } );
+
+  // the blocks holding positions, and the splits at their ends
+  vector<uint64_t> blocks;
+  for ( auto i : order ) {
+    uint64_t b = positions[i] / STRIDE * STRIDE;
+    if ( blocks.empty() or blocks.back() != b ) {
+      blocks.push_back( b );
+    }
+  }
+  map<uint64_t, vector<uint64_t>> split;
+  vector<uint64_t> missing;
+  for ( auto b : blocks ) {
+    for ( auto p : {b, min( size, b + STRIDE )} ) {
+      if ( split.count( p ) ) {
+        continue;
+      }
+      auto it = splitters_.find( p );
+      if ( it != splitters_.end() ) {
+        split.emplace( p, it->second );
+      } else {
+        split.emplace( p, vector<uint64_t>() );
+        missing.push_back( p );
+      }
+    }
+  }
+  if ( not missing.empty() ) {
+    for ( auto & c : clients_ ) {
+      c.sendSize();
+    }
+    vector<uint64_t> sizes;
+    for ( auto & c : clients_ ) {
+      sizes.push_back( c.recvSize() );
+    }
+    vector<vector<uint64_t>> found = Splits( sizes, missing );
+    for ( uint64_t i = 0; i < missing.size(); i++ ) {
+      if ( splitters_.size() < Knobs::GET_SPLITTER_CACHE ) {
+        splitters_.emplace( missing[i], found[i] );
+      }
+      split[missing[i]] = move( found[i] );
+    }
+  }
+
+  vector<vector<Entry>> entries;
+  auto next = order.begin();
+  for ( uint64_t i = 0; i < blocks.size(); i += PIPELINE ) {
+    uint64_t last = min( blocks.size(), i + PIPELINE );
+
+    for ( uint64_t b = i; b < last; b++ ) {
+      const vector<uint64_t> & lo = split[blocks[b]];
+      const vector<uint64_t> & hi = split[min( size, blocks[b] + STRIDE )];
+      for ( uint64_t n = 0; n < clients_.size(); n++ ) {
+        if ( hi[n] > lo[n] ) {
+          clients_[n].sendIRead( lo[n], hi[n] - lo[n] );
+        }
+      }
+    }
+
+    entries.assign( last - i, vector<Entry>() );
+    for ( uint64_t b = i; b < last; b++ ) {
+      uint64_t bend = min( size, blocks[b] + STRIDE );
+      const vector<uint64_t> & lo = split[blocks[b]];
+      const vector<uint64_t> & hi = split[bend];
+      vector<Entry> & block = entries[b - i];
+      for ( uint64_t n = 0; n < clients_.size(); n++ ) {
+        if ( hi[n] > lo[n] ) {
+          uint64_t nrecs = clients_[n].recvIRead();
+          for ( uint64_t j = 0; j < nrecs; j++ ) {
+            block.push_back( {clients_[n].readIRecord(), n, lo[n] + j} );
+          }
+        }
+      }
+      stable_sort( block.begin(), block.end(),
+                   []( const Entry & x, const Entry & y ) {
+        return memcmp( x.rec.key(), y.rec.key(), Rec::KEY_LEN ) < 0;
+      } );
+      if ( block.size() != bend - blocks[b] ) {
+        throw runtime_error( "Splitters disagree with nodes" );
+      }
+    }
+
+    // positions in this slice of blocks
+    for ( uint64_t b = i; b < last; b++ ) {
+      for ( ; next != order.end() and positions[*next] / STRIDE * STRIDE
+                                        == blocks[b]; next++ ) {
+        Entry & e = entries[b - i][positions[*next] - blocks[b]];
+        local[e.node].push_back( e.pos );
+        slot[e.node].push_back( *next );
+      }
+    }
+  }
+}
+
 void Cluster::ReadAll( void )
 {
   if ( clients_.size() == 1 ) {
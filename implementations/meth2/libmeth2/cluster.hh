@@ -1,6 +1,7 @@
 #ifndef METH2_CLUSTER2_HH
 #define METH2_CLUSTER2_HH
 
+#include <map>
 #include <vector>
 
 #include "address.hh"
@@ -24,6 +25,18 @@ private:
   std::vector<Client> clients_;
   uint64_t chunkSize_;
 
+  /* With a global index, each node holds one range of positions: client i
+   * holds [offsets_[i], offsets_[i] + sizes_[i]) */
+  bool global_;
+  std::vector<uint64_t> sizes_;
+  std::vector<uint64_t> offsets_;
+
+  /* Without one, where the nodes split at (up to GET_SPLITTER_CACHE of) the
+   * GET_SPLITTER_STRIDE'th positions we've needed so far: position -> records
+   * before it on each */
+  std::map<uint64_t, std::vector<uint64_t>> splitters_;
+  uint64_t splitSize_;
+
 public:
   struct NodeSplit {
       NodeSplit() : clientNo(0), size(0),
@@ -49,11 +62,28 @@ public:
   Record ReadFirst( void );
   void Read( uint64_t pos, uint64_t size );
   void ReadAll( void );
+
+  /* Smallest (up to) limit records with keys in [lo, hi) */
+  std::vector<Record> ReadRange( const uint8_t * lo, const uint8_t * hi,
+                                 uint64_t limit );
+
+  /* Records at each of a batch of (scattered) positions, in the same order */
+  std::vector<Record> Get( const std::vector<uint64_t> & positions );
+
+  /* Have a node index a new data file of its own, returning once it serves
+   * it. Throws, with the node's reason, if it refused or indexing failed. */
+  void AddFile( uint64_t node, std::string file );
   void WriteAll( File out );
 private:
   uint64_t Size( Client &c );
   std::vector<RecordLoc> IRead( Client &c, uint64_t pos, uint64_t size );
-  uint64_t IBSearch( Client &c, RecordLoc &rl);
+  void GlobalRead( uint64_t pos, uint64_t size );
+  std::vector<std::vector<uint64_t>>
+  Splits( const std::vector<uint64_t> & sizes,
+          const std::vector<uint64_t> & targets );
+  void Resolve( const std::vector<uint64_t> & positions, uint64_t size,
+                std::vector<std::vector<uint64_t>> & local,
+                std::vector<std::vector<uint64_t>> & slot );
 };
 }
 
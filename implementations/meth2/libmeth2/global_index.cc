@@ -0,0 +1,344 @@
+#include <sys/socket.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <exception>
+#include <iostream>
+
+#include "exception.hh"
+#include "timestamp.hh"
+
+#include "node.hh"
+#include "circular_aio.hh"
+#include "global_index.hh"
+
+using namespace std;
+using namespace meth2;
+
+/* fetch request entry: <uint32_t disk, uint64_t loc> */
+static constexpr size_t FETCH_REC = sizeof( uint32_t ) + sizeof( uint64_t );
+
+static void write_u64( TCPSocket & sock, uint64_t v )
+{
+  sock.write_all( reinterpret_cast<const char *>( &v ), sizeof( v ) );
+}
+
+static uint64_t read_u64( TCPSocket & sock )
+{
+  uint64_t v;
+  if ( sock.read_all( reinterpret_cast<char *>( &v ), sizeof( v ) )
+      != sizeof( v ) ) {
+    throw runtime_error( "Peer closed connection" );
+  }
+  return v;
+}
+
+static TCPSocket connect_with_backoff( const Address & addr )
+{
+  auto start = time_now();
+  size_t backoff = Knobs::CONNECT_BACKOFF_MS;
+  while ( true ) {
+    TCPSocket sock{(IPVersion) addr.domain()};
+    sock.set_nodelay();
+    sock.set_send_buffer( Knobs::NET_SND_BUF );
+    sock.set_recv_buffer( Knobs::NET_RCV_BUF );
+    try {
+      sock.connect( addr );
+      return sock;
+    } catch ( const unix_error & e ) {
+      if ( e.code().value() != ECONNREFUSED
+          or time_diff<ms>( start ) >= Knobs::CONNECT_TIMEOUT * 1000 ) {
+        throw;
+      }
+    }
+    this_thread::sleep_for( chrono::milliseconds( backoff ) );
+    backoff = min( backoff * 2, Knobs::CONNECT_BACKOFF_MAX_MS );
+  }
+}
+
+GlobalIndex::GlobalIndex( uint32_t id, vector<Address> peers,
+                          vector<File> & data, ValueCache * cache )
+  : id_{id}
+  , peers_{peers}
+  , data_{data}
+  , cache_{cache}
+  , out_{}
+  , in_{}
+  , servers_{}
+  , sizes_{}
+{
+  if ( id_ >= peers_.size() ) {
+    throw runtime_error( "Node ID not in peer list" );
+  }
+
+  TCPSocket sock{IPV4};
+  sock.set_reuseaddr();
+  sock.bind( {"0.0.0.0", peers_[id_].port()} );
+  sock.listen( peers_.size() );
+
+  // accept from everyone while connecting to everyone
+  in_.resize( peers_.size() );
+  exception_ptr err;
+  thread acceptor( [this, &sock, &err]() {
+    try {
+      for ( size_t i = 0; i < peers_.size() - 1; i++ ) {
+        TCPSocket c = sock.accept();
+        c.set_nodelay();
+        uint32_t node;
+        if ( c.read_all( reinterpret_cast<char *>( &node ), sizeof( node ) )
+            != sizeof( node ) or node >= peers_.size() or node == id_ ) {
+          throw runtime_error( "Bad peer hello" );
+        }
+        in_[node] = move( c );
+      }
+    } catch ( ... ) {
+      err = current_exception();
+    }
+  } );
+
+  for ( uint32_t n = 0; n < peers_.size(); n++ ) {
+    if ( n == id_ ) {
+      out_.emplace_back( IPV4 );
+    } else {
+      out_.push_back( connect_with_backoff( peers_[n] ) );
+      out_.back().write_all( reinterpret_cast<const char *>( &id_ ),
+                             sizeof( id_ ) );
+    }
+  }
+  acceptor.join();
+  if ( err ) {
+    rethrow_exception( err );
+  }
+}
+
+GlobalIndex::~GlobalIndex( void )
+{
+  // wake our servers blocked on reads
+  for ( uint32_t n = 0; n < in_.size(); n++ ) {
+    if ( n != id_ ) {
+      ::shutdown( in_[n].fd_num(), SHUT_RDWR );
+    }
+  }
+  for ( auto & t : servers_ ) {
+    t.join();
+  }
+}
+
+void GlobalIndex::exchange( function<void( uint32_t, TCPSocket & )> send,
+                            function<void( uint32_t, TCPSocket & )> recv )
+{
+  vector<thread> receivers;
+  vector<exception_ptr> errs( nodes() );
+  for ( uint32_t n = 0; n < nodes(); n++ ) {
+    if ( n != id_ ) {
+      receivers.emplace_back( [this, n, &recv, &errs]() {
+        try {
+          recv( n, in_[n] );
+        } catch ( ... ) {
+          errs[n] = current_exception();
+        }
+      } );
+    }
+  }
+  for ( uint32_t n = 0; n < nodes(); n++ ) {
+    if ( n != id_ ) {
+      send( n, out_[n] );
+    }
+  }
+  for ( auto & t : receivers ) {
+    t.join();
+  }
+  for ( auto & e : errs ) {
+    if ( e ) {
+      rethrow_exception( e );
+    }
+  }
+}
+
+void GlobalIndex::shuffle( vector<RecordLoc> & recs )
+{
+  auto t0 = time_now();
+  auto key_less = []( const RecordLoc & a, const RecordLoc & b ) {
+    return memcmp( a.key(), b.key(), Rec::KEY_LEN ) < 0;
+  };
+
+  // entries of our index point at our values
+  for ( auto & r : recs ) {
+    r.host_ = id_;
+  }
+
+  // sample our index, and gather everyone else's samples
+  vector<string> samples( nodes() );
+  uint64_t nsamples = min( SAMPLES, uint64_t( recs.size() ) );
+  for ( uint64_t i = 0; i < nsamples; i++ ) {
+    samples[id_].append( (const char *) recs[i * recs.size() / nsamples].key(),
+                         Rec::KEY_LEN );
+  }
+  exchange(
+    [&samples, this]( uint32_t, TCPSocket & s ) {
+      write_u64( s, samples[id_].size() );
+      s.write_all( samples[id_] );
+    },
+    [&samples]( uint32_t n, TCPSocket & s ) {
+      uint64_t len = read_u64( s );
+      samples[n] = s.read_all( len );
+      if ( samples[n].size() != len ) {
+        throw runtime_error( "Truncated samples" );
+      }
+    } );
+
+  // every node sees the same samples, so picks the same ranges: node n holds
+  // keys in [splits[n-1], splits[n])
+  vector<RecordLoc> keys;
+  for ( auto & s : samples ) {
+    for ( size_t i = 0; i < s.size(); i += Rec::KEY_LEN ) {
+      keys.emplace_back( (const uint8_t *) s.data() + i );
+    }
+  }
+  sort( keys.begin(), keys.end(), key_less );
+  vector<size_t> bounds( nodes() + 1, 0 );
+  for ( uint32_t n = 1; n < nodes(); n++ ) {
+    if ( not keys.empty() ) {
+      RecordLoc & split = keys[n * keys.size() / nodes()];
+      bounds[n] = lower_bound( recs.begin(), recs.end(), split, key_less )
+                  - recs.begin();
+    }
+  }
+  bounds[nodes()] = recs.size();
+
+  // send each node the entries in its range, receiving ours from them
+  vector<vector<RecordLoc>> runs( nodes() );
+  exchange(
+    [&recs, &bounds]( uint32_t n, TCPSocket & s ) {
+      uint64_t cnt = bounds[n + 1] - bounds[n];
+      write_u64( s, cnt );
+      if ( cnt > 0 ) {
+        s.write_all( (const char *) &recs[bounds[n]],
+                     cnt * sizeof( RecordLoc ) );
+      }
+    },
+    [&runs]( uint32_t n, TCPSocket & s ) {
+      uint64_t cnt = read_u64( s );
+      runs[n].resize( cnt );
+      size_t len = cnt * sizeof( RecordLoc );
+      if ( cnt > 0 and s.read_all( (char *) runs[n].data(), len ) != len ) {
+        throw runtime_error( "Truncated index entries" );
+      }
+    } );
+  runs[id_].assign( recs.begin() + bounds[id_],
+                    recs.begin() + bounds[id_ + 1] );
+  recs.clear();
+  recs.shrink_to_fit();
+
+  uint64_t total = 0;
+  for ( auto & r : runs ) {
+    total += r.size();
+  }
+  recs.reserve( total );
+  for ( auto & r : runs ) {
+    recs.insert( recs.end(), r.begin(), r.end() );
+    r = vector<RecordLoc>();
+  }
+  rec_sort( recs.begin(), recs.end() );
+
+  // learn how much everyone holds
+  sizes_.assign( nodes(), 0 );
+  sizes_[id_] = recs.size();
+  exchange(
+    [&recs]( uint32_t, TCPSocket & s ) { write_u64( s, recs.size() ); },
+    [this]( uint32_t n, TCPSocket & s ) { sizes_[n] = read_u64( s ); } );
+
+  for ( uint32_t n = 0; n < nodes(); n++ ) {
+    if ( n != id_ ) {
+      servers_.emplace_back( &GlobalIndex::serve, this, n );
+    }
+  }
+
+  cout << "shuffle: " << time_diff<ms>( t0 ) << "mS, " << recs.size()
+       << " entries from " << offset() << endl;
+}
+
+uint64_t GlobalIndex::offset( void ) const noexcept
+{
+  uint64_t off = 0;
+  for ( uint32_t n = 0; n < id_ and n < sizes_.size(); n++ ) {
+    off += sizes_[n];
+  }
+  return off;
+}
+
+vector<Record> GlobalIndex::fetch( uint32_t node,
+                                   const vector<RecordLoc> & recs )
+{
+  vector<Record> vals( recs.size() );
+  if ( recs.empty() ) {
+    return vals;
+  }
+
+  if ( node == id_ ) {
+    vector<RecordLoc> locs( recs );
+    Circular_AIO caio( data_, locs, cache_ );
+    caio.begin( &vals, 0, locs.size() );
+    caio.wait();
+    return vals;
+  }
+
+  string req;
+  req.reserve( sizeof( uint64_t ) + recs.size() * FETCH_REC );
+  uint64_t n = recs.size();
+  req.append( (const char *) &n, sizeof( n ) );
+  for ( auto & r : recs ) {
+    uint32_t disk = r.disk();
+    uint64_t loc = r.loc();
+    req.append( (const char *) &disk, sizeof( disk ) );
+    req.append( (const char *) &loc, sizeof( loc ) );
+  }
+  out_[node].write_all( req );
+
+  string reply = out_[node].read_all( n * Rec::VAL_LEN );
+  if ( reply.size() != n * Rec::VAL_LEN ) {
+    throw runtime_error( "Truncated fetch reply" );
+  }
+  for ( uint64_t i = 0; i < n; i++ ) {
+    vals[i] = Record( recs[i], (const uint8_t *) reply.data()
+                                 + i * Rec::VAL_LEN );
+  }
+  return vals;
+}
+
+void GlobalIndex::serve( uint32_t node )
+{
+  TCPSocket & sock = in_[node];
+  try {
+    while ( true ) {
+      uint64_t n;
+      if ( sock.read_all( reinterpret_cast<char *>( &n ), sizeof( n ) )
+          != sizeof( n ) ) {
+        return; // peer done
+      }
+
+      string req = sock.read_all( n * FETCH_REC );
+      if ( req.size() != n * FETCH_REC ) {
+        throw runtime_error( "Truncated fetch request" );
+      }
+      vector<RecordLoc> recs( n );
+      for ( uint64_t i = 0; i < n; i++ ) {
+        const char * e = req.data() + i * FETCH_REC;
+        memcpy( &recs[i].disk_, e, sizeof( uint32_t ) );
+        memcpy( &recs[i].loc_, e + sizeof( uint32_t ), sizeof( uint64_t ) );
+        recs[i].host_ = id_;
+      }
+
+      vector<Record> vals = fetch( id_, recs );
+      string reply;
+      reply.reserve( n * Rec::VAL_LEN );
+      for ( auto & v : vals ) {
+        reply.append( (const char *) v.val(), Rec::VAL_LEN );
+      }
+      sock.write_all( reply );
+    }
+  } catch ( const exception & e ) {
+    print_exception( e );
+  }
+}
@@ -0,0 +1,90 @@
+#ifndef METH2_GLOBAL_INDEX_HH
+#define METH2_GLOBAL_INDEX_HH
+
+#include <functional>
+#include <thread>
+#include <vector>
+
+#include "address.hh"
+#include "file.hh"
+#include "socket.hh"
+
+#include "record.hh"
+
+#include "value_cache.hh"
+
+#include "tune_knobs.hh"
+
+namespace meth2
+{
+
+/**
+ * GlobalIndex turns the local indexes of a set of nodes into one distributed
+ * index: once each node has sorted its own index, the nodes agree on key
+ * ranges (from samples of their indexes) and shuffle their index entries so
+ * each node holds all entries of one contiguous range. Node i's range follows
+ * node i-1's, so a global position maps to a single node without any search.
+ *
+ * Values stay where they are, with entries recording the node (host) holding
+ * them, so nodes fetch values of entries from each other when serving reads.
+ * Nodes talk to each other over a connection per ordered pair, on the peer
+ * addresses, which after the shuffle carry value fetches.
+ */
+class GlobalIndex
+{
+public:
+  static constexpr uint64_t SAMPLES = Knobs::GLOBAL_INDEX_SAMPLES;
+
+private:
+  uint32_t id_;
+  std::vector<Address> peers_;
+  std::vector<File> & data_;
+  ValueCache * cache_;
+
+  /* by node ID, to and from the other nodes */
+  std::vector<TCPSocket> out_;
+  std::vector<TCPSocket> in_;
+  std::vector<std::thread> servers_;
+
+  /* index entries each node holds */
+  std::vector<uint64_t> sizes_;
+
+  /* Run send for each other node's outgoing socket, while running recv for
+   * each other node's incoming socket */
+  void exchange( std::function<void( uint32_t, TCPSocket & )> send,
+                 std::function<void( uint32_t, TCPSocket & )> recv );
+
+  /* Serve value fetches from a node */
+  void serve( uint32_t node );
+
+public:
+  /* Connect to the other nodes, as node id of peers, reading our values
+   * through cache (if any) */
+  GlobalIndex( uint32_t id, std::vector<Address> peers,
+               std::vector<File> & data, ValueCache * cache = nullptr );
+
+  /* no copy or move */
+  GlobalIndex( const GlobalIndex & ) = delete;
+  GlobalIndex & operator=( const GlobalIndex & ) = delete;
+
+  ~GlobalIndex( void );
+
+  /* Swap our sorted local index for our range of the global index. Peaks at
+   * about twice the index in memory: while sending, we hold our whole local
+   * index and the entries received for our range, and then the received runs
+   * while copying them into one to sort. */
+  void shuffle( std::vector<RecordLoc> & recs );
+
+  /* Values for index entries held by a node, in order */
+  std::vector<Record> fetch( uint32_t node,
+                             const std::vector<RecordLoc> & recs );
+
+  uint32_t id( void ) const noexcept { return id_; }
+  size_t nodes( void ) const noexcept { return peers_.size(); }
+
+  /* Global position of our first entry */
+  uint64_t offset( void ) const noexcept;
+};
+}
+
+#endif /* METH2_GLOBAL_INDEX_HH */
@@ -0,0 +1,108 @@
+#include <algorithm>
+#include <cstring>
+#include <iostream>
+
+#include "timestamp.hh"
+
+#include "learned_index.hh"
+
+using namespace std;
+using namespace meth2;
+
+static constexpr uint64_t RADIX_SHIFT = 64 - LearnedIndex::RADIX_BITS;
+
+LearnedIndex::LearnedIndex( void )
+  : segs_{}
+  , size_{0}
+  , radix_{}
+{
+}
+
+uint64_t LearnedIndex::prefix( const uint8_t * key ) noexcept
+{
+  uint64_t p;
+  memcpy( &p, key, sizeof( p ) );
+  return __builtin_bswap64( p );
+}
+
+uint64_t LearnedIndex::predict( const Segment & s, uint64_t p ) const noexcept
+{
+  double off = double( p - s.first ) * s.slope;
+  return off < double( s.end - s.start ) ? s.start + uint64_t( off ) : s.end;
+}
+
+void LearnedIndex::train( const vector<RecordLoc> & recs )
+{
+  auto t0 = time_now();
+  segs_.clear();
+  radix_.clear();
+  size_ = recs.size();
+  if ( size_ == 0 ) {
+    return;
+  }
+
+  // cut segments every SEGMENT records, moving cuts on to where the prefix
+  // changes so a prefix never spans segments
+  for ( uint64_t i = 0; i < size_; ) {
+    uint64_t start = i;
+    i = min( i + SEGMENT, size_ );
+    while ( i < size_
+            and prefix( recs[i - 1].key() ) == prefix( recs[i].key() ) ) {
+      i++;
+    }
+    segs_.push_back( {prefix( recs[start].key() ), start, i, 0, 0} );
+  }
+
+  // fit each segment through its first record and the next segment's first,
+  // then measure how far off that is over its records
+  uint64_t maxErr = 0;
+  for ( uint64_t s = 0; s < segs_.size(); s++ ) {
+    Segment & seg = segs_[s];
+    long double dp = s + 1 < segs_.size()
+      ? (long double) ( segs_[s + 1].first - seg.first )
+      : (long double) ( prefix( recs[seg.end - 1].key() ) - seg.first ) + 1;
+    seg.slope = double( ( seg.end - seg.start ) / dp );
+
+    for ( uint64_t i = seg.start; i < seg.end; i++ ) {
+      uint64_t pred = predict( seg, prefix( recs[i].key() ) );
+      uint64_t err = pred > i ? pred - i : i - pred;
+      seg.err = max( seg.err, err );
+    }
+    maxErr = max( maxErr, seg.err );
+  }
+
+  radix_.resize( ( uint64_t( 1 ) << RADIX_BITS ) + 1 );
+  uint64_t s = 0;
+  for ( uint64_t r = 0; r < radix_.size(); r++ ) {
+    while ( s < segs_.size() and ( segs_[s].first >> RADIX_SHIFT ) < r ) {
+      s++;
+    }
+    radix_[r] = s;
+  }
+
+  cout << "learned-index: " << time_diff<ms>( t0 ) << "mS, " << segs_.size()
+       << " segments, max error " << maxErr << endl;
+}
+
+void LearnedIndex::window( const uint8_t * key, uint64_t & lo,
+                           uint64_t & hi ) const
+{
+  uint64_t p = prefix( key );
+
+  // last segment starting at or before p
+  uint64_t r = p >> RADIX_SHIFT;
+  auto first = segs_.begin() + radix_[r];
+  auto last = segs_.begin() + radix_[r + 1];
+  auto it = upper_bound( first, last, p, []( uint64_t v, const Segment & s ) {
+    return v < s.first;
+  } );
+  if ( it == segs_.begin() ) {
+    lo = hi = 0;
+    return;
+  }
+  const Segment & seg = *( it - 1 );
+
+  uint64_t pred = predict( seg, p );
+  lo = pred > seg.start + seg.err ? pred - seg.err : seg.start;
+  hi = min( pred + seg.err + 1, seg.end );
+}
@@ -0,0 +1,66 @@
+#ifndef METH2_LEARNED_INDEX_HH
+#define METH2_LEARNED_INDEX_HH
+
+#include <vector>
+
+#include "record.hh"
+
+#include "tune_knobs.hh"
+
+namespace meth2
+{
+
+/**
+ * LearnedIndex predicts where a key falls in a sorted index, so lookups search
+ * a small window rather than the whole index.
+ *
+ * Keys are modelled by their leading 8 bytes (the prefix), which for gensort
+ * data are near uniform. The index is cut into segments of about SEGMENT
+ * records, each with a linear model from prefix to position and the worst
+ * error of that model over the segment. A table on the leading RADIX_BITS of
+ * the prefix narrows which segment a prefix falls in.
+ */
+class LearnedIndex
+{
+public:
+  static constexpr bool ENABLED = Knobs::LEARNED_INDEX;
+  static constexpr uint64_t SEGMENT = Knobs::LEARNED_INDEX_SEGMENT;
+  static constexpr uint64_t RADIX_BITS = Knobs::LEARNED_INDEX_RADIX_BITS;
+
+private:
+  struct Segment
+  {
+    uint64_t first; // prefix of first record
+    uint64_t start; // position of first record
+    uint64_t end;   // position after last record
+    double slope;   // positions per prefix
+    uint64_t err;   // max model error
+  };
+
+  /* segments by first prefix, all distinct */
+  std::vector<Segment> segs_;
+  uint64_t size_;
+
+  /* radix_[r] is the first segment whose first prefix has leading bits >= r */
+  std::vector<uint32_t> radix_;
+
+  static uint64_t prefix( const uint8_t * key ) noexcept;
+  uint64_t predict( const Segment & s, uint64_t p ) const noexcept;
+
+public:
+  LearnedIndex( void );
+
+  /* Fit the model to a sorted index */
+  void train( const std::vector<RecordLoc> & recs );
+
+  bool trained( void ) const noexcept { return size_ > 0; }
+  size_t segments( void ) const noexcept { return segs_.size(); }
+
+  /* Set [lo, hi] to a window of positions holding every record with key's
+   * prefix, as well as both the first record at or after key and the first
+   * after it */
+  void window( const uint8_t * key, uint64_t & lo, uint64_t & hi ) const;
+};
+}
+
+#endif /* METH2_LEARNED_INDEX_HH */
@@ -1,6 +1,11 @@
 #include <algorithm>
 #include <cassert>
+#include <cstring>
 #include <system_error>
+#include <exception>
+#include <future>
+#include <mutex>
+#include <thread>
 #include <vector>
 #include <chrono>
 #include <utility>
@@ -14,6 +19,7 @@
 #include "linux_compat.hh"
 #include "overlapped_rec_io.hh"
 #include "socket.hh"
+#include "threadpool.hh"
 #include "timestamp.hh"
 #include "util.hh"
 
@@ -33,7 +39,18 @@ Node::Node( vector<string> files, string port )
   port_{port},
   last_{Rec::MIN},
   fpos_{0},
-  lpass_{0}
+  lpass_{0},
+  global_{},
+  learned_{},
+  cache_{ValueCache::ENABLED ? new ValueCache : nullptr},
+  runs_{},
+  mtx_{},
+  addMtx_{},
+  addCv_{},
+  adds_{},
+  added_{},
+  closing_{false},
+  indexer_{}
 {
     for (string &f : files) {
 	data_.emplace_back(f.c_str(), O_RDONLY);
@@ -41,36 +58,132 @@ Node::Node( vector<string> files, string port )
     }
 }
 
+Node::~Node( void )
+{
+  {
+    unique_lock<mutex> add( addMtx_ );
+    closing_ = true;
+  }
+  addCv_.notify_one();
+  if ( indexer_.joinable() ) {
+    indexer_.join();
+  }
+}
+
+void Node::Globalize( uint32_t id, vector<Address> peers )
+{
+  global_.reset( new GlobalIndex( id, peers, data_, cache_.get() ) );
+}
+
 void Node::Initialize( void )
 {
     auto start = time_now();
-    // Load records
-    recs_.reserve(Size());
+
+    // Each disk loads into its own slice of the index
+    vector<uint64_t> first(data_.size() + 1, 0);
+    for (size_t d = 0; d < data_.size(); d++) {
+	first[d + 1] = first[d] + data_[d].size() / Rec::SIZE;
+    }
+    recs_.resize(first.back());
+
+    // Load all disks at once, sorting chunks of a slice as they fill. They
+    // share the read-ahead one disk would have.
+    size_t blocks = max(size_t(3),
+			size_t(Knobs::DISK_BLOCKS / max(size_t(1), data_.size())));
+    ThreadPool pool;
+    mutex mtx;
+    vector<pair<uint64_t, uint64_t>> runs;
+    vector<future<void>> sorts;
+    vector<thread> loaders;
+    vector<exception_ptr> errs(data_.size());
     for (size_t d = 0; d < data_.size(); d++) {
-	OverlappedRecordIO<Rec::SIZE> cio(data_[d]);
-	size_t nrecs = data_[d].size() / Rec::SIZE;
-
-	cio.rewind();
-	for (uint64_t i = 0; i < nrecs; i++) {
-	    const uint8_t *rec = (const uint8_t *)cio.next_record();
-	    recs_.emplace_back(/*key*/rec,
-			       /*loc*/i * Rec::SIZE + Rec::KEY_LEN,
-			       /*host*/0,
-			       /*disk*/d);
+	loaders.emplace_back([this, d, blocks, &first, &pool, &mtx, &runs,
+			      &sorts, &errs]() {
+	    try {
+		OverlappedRecordIO<Rec::SIZE> cio(data_[d], blocks);
+		cio.rewind();
+		uint64_t cstart = first[d];
+		for (uint64_t i = first[d]; i < first[d + 1]; i++) {
+		    const uint8_t *rec = (const uint8_t *)cio.next_record();
+		    recs_[i].copy(/*key*/rec,
+				  /*loc*/(i - first[d]) * Rec::SIZE + Rec::KEY_LEN,
+				  /*host*/0,
+				  /*disk*/d);
+		    if (i + 1 - cstart == Knobs::INDEX_SORT_CHUNK
+			    || i + 1 == first[d + 1]) {
+			RecordLoc *s = recs_.data() + cstart;
+			RecordLoc *e = recs_.data() + i + 1;
+			unique_lock<mutex> lck(mtx);
+			runs.emplace_back(cstart, i + 1);
+			sorts.push_back(pool.enqueue([s, e]() { rec_sort(s, e); }));
+			cstart = i + 1;
+		    }
+		}
+	    } catch (...) {
+		errs[d] = current_exception();
+	    }
+	});
+    }
+    for (auto &t : loaders) {
+	t.join();
+    }
+    for (auto &e : errs) {
+	if (e) {
+	    rethrow_exception(e);
 	}
     }
 
     auto loadTime = time_diff<ms>(start);
     start = time_now();
 
-    // Sort
-    rec_sort(recs_.begin(), recs_.end());
+    for (auto &f : sorts) {
+	f.get();
+    }
+
+    // Merge adjacent sorted runs pairwise, in parallel, until one is left.
+    // In place, with a bounded scratch buffer split between each round's
+    // merges, so we never hold a second copy of the index.
+    sort(runs.begin(), runs.end());
+    vector<RecordLoc> buf;
+    if (runs.size() > 1) {
+	buf.resize(min(uint64_t(recs_.size()), Knobs::INDEX_MERGE_BUFFER));
+    }
+    while (runs.size() > 1) {
+	vector<pair<uint64_t, uint64_t>> next;
+	vector<future<void>> merges;
+	size_t each = buf.size() / (runs.size() / 2);
+	for (size_t i = 0; i + 1 < runs.size(); i += 2) {
+	    auto a = runs[i], b = runs[i + 1];
+	    RecordLoc *r = recs_.data(), *scratch = buf.data() + i / 2 * each;
+	    merges.push_back(pool.enqueue([r, scratch, each, a, b]() {
+		pmerge_inplace(r + a.first, r + b.first, r + b.second,
+			       scratch, each);
+	    }));
+	    next.emplace_back(a.first, b.second);
+	}
+	if (runs.size() % 2 == 1) {
+	    next.push_back(runs.back());
+	}
+	for (auto &f : merges) {
+	    f.get();
+	}
+	runs = move(next);
+    }
 
     auto sortTime = time_diff<ms>(start);
 
     cout << "load: " << loadTime << "mS" << endl;
     cout << "sort: " << sortTime << "mS" << endl;
 
+    // Trade our index for our range of the global one
+    if (global_) {
+	global_->shuffle(recs_);
+    }
+
+    if (LearnedIndex::ENABLED) {
+	learned_.train(recs_);
+    }
+
     return;
 }
 
@@ -90,9 +203,14 @@ void Node::Run( void )
         const char * str = client.read_buf_all( 1 ).first;
         if ( client.eof() ) {
           cout << "Client EOF" << endl;
+          if ( cache_ ) {
+            cout << "value-cache, " << cache_->hits() << ", "
+                 << cache_->misses() << ", " << cache_->size() << endl;
+          }
           break;
         }
 	//cout << __builtin_readcyclecounter() << endl;
+        unique_lock<mutex> lck( mtx_ );
         switch ( str[0] ) {
         case 0:
           RPC_Read( client );
@@ -103,6 +221,27 @@ void Node::Run( void )
         case 2:
           RPC_Size( client );
           break;
+        case 3:
+          RPC_Info( client );
+          break;
+        case 4:
+          RPC_Rank( client );
+          break;
+        case 5:
+          RPC_Select( client );
+          break;
+        case 6:
+          RPC_ReadRange( client );
+          break;
+        case 7:
+          RPC_Get( client );
+          break;
+        case 8:
+          RPC_AddFile( client );
+          break;
+        case 9:
+          RPC_AddStatus( client );
+          break;
         default:
           throw runtime_error( "Unknown RPC method: " + to_string(str[0]) );
           break;
@@ -132,6 +271,76 @@ void Node::RPC_Read( BufferedIO_O<TCPSocket> & client )
 
   //cout << recs.size() << endl;
 
+  write_recs( client, recs );
+}
+
+void Node::RPC_ReadRange( BufferedIO_O<TCPSocket> & client )
+{
+  const char * str =
+    client.read_buf_all( 2 * Rec::KEY_LEN + 2 * sizeof( uint64_t ) ).first;
+  uint8_t lo[Rec::KEY_LEN], hi[Rec::KEY_LEN];
+  memcpy( lo, str, Rec::KEY_LEN );
+  memcpy( hi, str + Rec::KEY_LEN, Rec::KEY_LEN );
+  uint64_t limit =
+    *( reinterpret_cast<const uint64_t *>( str + 2 * Rec::KEY_LEN ) );
+  uint64_t skip = *( reinterpret_cast<const uint64_t *>(
+    str + 2 * Rec::KEY_LEN + sizeof( uint64_t ) ) );
+
+  write_recs( client, ReadRange( lo, skip, hi, limit ) );
+}
+
+void Node::RPC_Get( BufferedIO_O<TCPSocket> & client )
+{
+  const char * str = client.read_buf_all( sizeof( uint64_t ) ).first;
+  uint64_t n = *( reinterpret_cast<const uint64_t *>( str ) );
+
+  vector<uint64_t> pos( n );
+  for ( auto & p : pos ) {
+    str = client.read_buf_all( sizeof( uint64_t ) ).first;
+    p = *( reinterpret_cast<const uint64_t *>( str ) );
+  }
+
+  write_recs( client, Get( pos ) );
+}
+
+void Node::RPC_AddFile( BufferedIO_O<TCPSocket> & client )
+{
+  const char * str = client.read_buf_all( sizeof( uint64_t ) ).first;
+  uint64_t len = *( reinterpret_cast<const uint64_t *>( str ) );
+  string file( client.read_buf_all( len ).first, len );
+
+  uint8_t ok = 1;
+  try {
+    AddFile( file );
+  } catch ( const exception & e ) {
+    cout << "Add file failed: " << e.what() << endl;
+    unique_lock<mutex> add( addMtx_ );
+    added_[file] = make_pair( ADD_FAILED, string( e.what() ) );
+    ok = 0;
+  }
+
+  client.write_all( reinterpret_cast<const char *>( &ok ), 1 );
+  client.flush( true );
+}
+
+void Node::RPC_AddStatus( BufferedIO_O<TCPSocket> & client )
+{
+  const char * str = client.read_buf_all( sizeof( uint64_t ) ).first;
+  uint64_t len = *( reinterpret_cast<const uint64_t *>( str ) );
+  string file( client.read_buf_all( len ).first, len );
+
+  string error;
+  uint8_t state = AddStatus( file, error );
+  len = error.size();
+
+  client.write_all( reinterpret_cast<const char *>( &state ), 1 );
+  client.write_all( reinterpret_cast<const char *>( &len ), sizeof( uint64_t ) );
+  client.write_all( error );
+  client.flush( true );
+}
+
+void Node::write_recs( BufferedIO_O<TCPSocket> & client, const RecV & recs )
+{
   uint64_t siz = recs.size();
   client.write_all( reinterpret_cast<const char *>( &siz ), sizeof( uint64_t ) );
   for ( auto const & r : recs ) {
@@ -155,8 +364,14 @@ void Node::RPC_IRead( BufferedIO_O<TCPSocket> & client )
   }
 
   client.write_all( reinterpret_cast<const char *>( &amt ), sizeof( uint64_t ) );
-  for (uint64_t i = 0; i < amt; i++) {
-    recs_[pos + i].write(client);
+  if (runs_.empty()) {
+    for (uint64_t i = 0; i < amt; i++) {
+      recs_[pos + i].write(client);
+    }
+  } else {
+    for (auto &r : merged(pos, amt)) {
+      r.write(client);
+    }
   }
   client.flush( true );
 }
@@ -169,6 +384,102 @@ void Node::RPC_Size( BufferedIO_O<TCPSocket> & client )
   client.flush( true );
 }
 
+void Node::RPC_Info( BufferedIO_O<TCPSocket> & client )
+{
+  uint8_t global = global_ ? 1 : 0;
+  uint32_t id = global_ ? global_->id() : 0;
+  client.write_all( reinterpret_cast<const char *>( &global ), 1 );
+  client.write_all( reinterpret_cast<const char *>( &id ), sizeof( id ) );
+  client.flush( true );
+}
+
+void Node::RPC_Rank( BufferedIO_O<TCPSocket> & client )
+{
+  const char * str = client.read_buf_all( Rec::KEY_LEN ).first;
+
+  uint64_t rank[2];
+  Rank( reinterpret_cast<const uint8_t *>( str ), rank[0], rank[1] );
+
+  client.write_all( reinterpret_cast<const char *>( rank ), sizeof( rank ) );
+  client.flush( true );
+}
+
+void Node::RPC_Select( BufferedIO_O<TCPSocket> & client )
+{
+  const char * str = client.read_buf_all( sizeof( uint64_t ) ).first;
+  uint64_t i = *( reinterpret_cast<const uint64_t *>( str ) );
+
+  client.write_all( reinterpret_cast<const char *>( Select( i ) ),
+                    Rec::KEY_LEN );
+  client.flush( true );
+}
+
+void Node::Rank( const uint8_t * key, uint64_t & below, uint64_t & upto )
+{
+  auto lt = []( const RecordLoc & r, const uint8_t * k ) {
+    return memcmp( r.key(), k, Rec::KEY_LEN ) < 0;
+  };
+  auto gt = []( const uint8_t * k, const RecordLoc & r ) {
+    return memcmp( k, r.key(), Rec::KEY_LEN ) < 0;
+  };
+
+  // the model narrows the search to a window holding both answers
+  auto first = recs_.begin(), last = recs_.end();
+  if ( learned_.trained() ) {
+    uint64_t lo, hi;
+    learned_.window( key, lo, hi );
+    first = recs_.begin() + lo;
+    last = recs_.begin() + hi;
+  }
+
+  auto lo = lower_bound( first, last, key, lt );
+  below = lo - recs_.begin();
+  upto = upper_bound( lo, last, key, gt ) - recs_.begin();
+
+  for ( auto & r : runs_ ) {
+    auto rlo = lower_bound( r.begin(), r.end(), key, lt );
+    below += rlo - r.begin();
+    upto += upper_bound( rlo, r.end(), key, gt ) - r.begin();
+  }
+}
+
+Node::RecV Node::ReadRange( const uint8_t * lo, uint64_t skip,
+                            const uint8_t * hi, uint64_t limit )
+{
+  // keys in range are the positions from the first at or above lo, to the
+  // first at or above hi
+  uint64_t start, end, upto;
+  Rank( lo, start, upto );
+  Rank( hi, end, upto );
+  start += skip;
+  limit = min( limit, Knobs::RANGE_MAX_RECORDS );
+  if ( end <= start or limit == 0 ) {
+    return {};
+  }
+  return Read( start, min( limit, end - start ) );
+}
+
+Node::RecV Node::Get( const vector<uint64_t> & pos )
+{
+  vector<RecordLoc> locs;
+  locs.reserve( pos.size() );
+  for ( auto p : pos ) {
+    if ( p >= IndexSize() ) {
+      throw runtime_error( "Get past end: " + to_string( p ) );
+    }
+    locs.push_back( runs_.empty() ? recs_[p] : at( p ) );
+  }
+  return fetch( locs );
+}
+
+const uint8_t * Node::Select( uint64_t i )
+{
+  if ( i >= IndexSize() ) {
+    throw runtime_error( "Select past end: " + to_string( i ) );
+  }
+  return runs_.empty() ? recs_[i].key() : at( i ).key();
+}
+
 Node::RecV Node::Read( uint64_t pos, uint64_t size )
 {
   static size_t pass = 0;
@@ -177,14 +488,19 @@ Node::RecV Node::Read( uint64_t pos, uint64_t size )
   Node::RecV recs;
 
   //if (size < 100) {
-  if (size < 64) {
+  if (global_) {
+    recs = global_read( pos, size );
+  } else if (not runs_.empty()) {
+    vector<RecordLoc> locs = merged( pos, size );
+    recs = fetch( locs );
+  } else if (size < 64) {
     recs = linear_scan( pos , size );
   } else {
     if (pos + size > recs_.size()) {
 	size = recs_.size() - pos;
     }
     recs.resize(size);
-    Circular_AIO caio(data_, recs_);
+    Circular_AIO caio(data_, recs_, cache_.get());
     caio.begin(&recs, pos, size);
     caio.wait();
   }
@@ -199,6 +515,12 @@ Node::RecV Node::Read( uint64_t pos, uint64_t size )
 }
 
 uint64_t Node::Size( void )
+{
+  // with a global index, we serve our range of it rather than our data
+  return global_ ? recs_.size() : DataSize();
+}
+
+uint64_t Node::DataSize( void )
 {
   uint64_t sz = 0;
 
@@ -228,8 +550,12 @@ Node::RecV Node::linear_scan(uint64_t start, uint64_t size )
       break;
     }
 
-    len = data_[r.disk()].pread_all((char *)&buf, Rec::VAL_LEN, r.loc());
-    assert(len == Rec::VAL_LEN);
+    if (cache_) {
+      cache_->read(data_[r.disk()], r.disk(), r.loc(), buf);
+    } else {
+      len = data_[r.disk()].pread_all((char *)&buf, Rec::VAL_LEN, r.loc());
+      assert(len == Rec::VAL_LEN);
+    }
 
     recV.emplace_back(recs_[start+i], buf);
   }
@@ -240,3 +566,345 @@ Node::RecV Node::linear_scan(uint64_t start, uint64_t size )
   return recV;
 }
 
+
+Node::RecV Node::global_read( uint64_t start, uint64_t size )
+{
+  if ( start >= recs_.size() ) {
+    return {};
+  }
+  size = min( size, recs_.size() - start );
+
+  vector<RecordLoc> locs( recs_.begin() + start,
+                          recs_.begin() + start + size );
+  return fetch( locs );
+}
+
+/* Values for a batch of index entries, read in parallel */
+Node::RecV Node::fetch( vector<RecordLoc> & locs )
+{
+  RecV recV( locs.size() );
+  if ( locs.empty() ) {
+    return recV;
+  } else if ( not global_ ) {
+    Circular_AIO caio( data_, locs, cache_.get() );
+    caio.begin( &recV, 0, locs.size() );
+    caio.wait();
+    return recV;
+  }
+
+  // group entries by the node holding their value
+  vector<vector<RecordLoc>> hlocs( global_->nodes() );
+  vector<vector<uint64_t>> idxs( global_->nodes() );
+  for ( uint64_t i = 0; i < locs.size(); i++ ) {
+    hlocs[locs[i].host()].push_back( locs[i] );
+    idxs[locs[i].host()].push_back( i );
+  }
+
+  // fetch from all of them at once
+  vector<thread> fetches;
+  vector<exception_ptr> errs( global_->nodes() );
+  for ( uint32_t n = 0; n < global_->nodes(); n++ ) {
+    if ( hlocs[n].empty() ) {
+      continue;
+    }
+    fetches.emplace_back( [this, n, &hlocs, &idxs, &recV, &errs]() {
+      try {
+        RecV vals = global_->fetch( n, hlocs[n] );
+        for ( uint64_t i = 0; i < vals.size(); i++ ) {
+          recV[idxs[n][i]] = move( vals[i] );
+        }
+      } catch ( ... ) {
+        errs[n] = current_exception();
+      }
+    } );
+  }
+  for ( auto & t : fetches ) {
+    t.join();
+  }
+  for ( auto & e : errs ) {
+    if ( e ) {
+      rethrow_exception( e );
+    }
+  }
+
+  return recV;
+}
+
+uint64_t Node::IndexSize( void ) const noexcept
+{
+  uint64_t n = recs_.size();
+  for ( auto & r : runs_ ) {
+    n += r.size();
+  }
+  return n;
+}
+
+/*
+ * Where the first pos records (in sorted order) end in each run, with ties
+ * going to earlier runs first. Found as Cluster::GetSplit finds the split
+ * across nodes: narrow a window on each run, pivoting on the weighted median
+ * of the windows' middle keys.
+ */
+void Node::split( uint64_t pos, vector<uint64_t> & at )
+{
+  auto lt = []( const RecordLoc & r, const uint8_t * k ) {
+    return memcmp( r.key(), k, Rec::KEY_LEN ) < 0;
+  };
+  auto gt = []( const uint8_t * k, const RecordLoc & r ) {
+    return memcmp( k, r.key(), Rec::KEY_LEN ) < 0;
+  };
+
+  size_t n = 1 + runs_.size();
+  vector<uint64_t> start( n, 0 ), end( n ), below( n ), upto( n );
+  for ( size_t r = 0; r < n; r++ ) {
+    end[r] = run( r ).size();
+  }
+  at.assign( n, 0 );
+
+  vector<size_t> cands;
+  while ( true ) {
+    uint64_t lo = 0, hi = 0;
+    for ( size_t r = 0; r < n; r++ ) {
+      lo += start[r];
+      hi += end[r];
+    }
+    if ( lo >= pos or hi <= pos ) {
+      at = lo >= pos ? start : end;
+      return;
+    }
+
+    cands.clear();
+    uint64_t weight = 0;
+    for ( size_t r = 0; r < n; r++ ) {
+      if ( start[r] < end[r] ) {
+        cands.push_back( r );
+        weight += end[r] - start[r];
+      }
+    }
+    auto mid = [this, &start, &end]( size_t r ) {
+      return run( r )[( start[r] + end[r] ) / 2].key();
+    };
+    sort( cands.begin(), cands.end(), [&mid]( size_t a, size_t b ) {
+      return memcmp( mid( a ), mid( b ), Rec::KEY_LEN ) < 0;
+    } );
+    uint64_t acc = 0;
+    const uint8_t * pivot = mid( cands.back() );
+    for ( auto r : cands ) {
+      acc += end[r] - start[r];
+      if ( acc * 2 >= weight ) {
+        pivot = mid( r );
+        break;
+      }
+    }
+
+    uint64_t sb = 0, su = 0;
+    for ( size_t r = 0; r < n; r++ ) {
+      auto & v = run( r );
+      auto it = lower_bound( v.begin(), v.end(), pivot, lt );
+      below[r] = it - v.begin();
+      upto[r] = upper_bound( it, v.end(), pivot, gt ) - v.begin();
+      sb += below[r];
+      su += upto[r];
+    }
+
+    if ( sb > pos ) {
+      for ( size_t r = 0; r < n; r++ ) {
+        end[r] = max( start[r], min( end[r], below[r] ) );
+      }
+    } else if ( su <= pos ) {
+      for ( size_t r = 0; r < n; r++ ) {
+        start[r] = min( end[r], max( start[r], upto[r] ) );
+      }
+    } else {
+      uint64_t rem = pos - sb;
+      for ( size_t r = 0; r < n; r++ ) {
+        uint64_t take = min( rem, upto[r] - below[r] );
+        at[r] = below[r] + take;
+        rem -= take;
+      }
+      return;
+    }
+  }
+}
+
+/* Index entry at position i across runs */
+const RecordLoc & Node::at( uint64_t i )
+{
+  vector<uint64_t> pos;
+  split( i, pos );
+
+  const RecordLoc * min = nullptr;
+  for ( size_t r = 0; r < pos.size(); r++ ) {
+    if ( pos[r] < run( r ).size()
+        and ( min == nullptr or memcmp( run( r )[pos[r]].key(), min->key(),
+                                        Rec::KEY_LEN ) < 0 ) ) {
+      min = &run( r )[pos[r]];
+    }
+  }
+  if ( min == nullptr ) {
+    throw runtime_error( "Position past end: " + to_string( i ) );
+  }
+  return *min;
+}
+
+/* Index entries at positions [pos, pos + size) across runs */
+vector<RecordLoc> Node::merged( uint64_t pos, uint64_t size )
+{
+  uint64_t total = IndexSize();
+  if ( pos >= total ) {
+    return {};
+  }
+  size = min( size, total - pos );
+
+  vector<uint64_t> next;
+  split( pos, next );
+
+  vector<RecordLoc> locs;
+  locs.reserve( size );
+  for ( uint64_t i = 0; i < size; i++ ) {
+    size_t m = next.size();
+    for ( size_t r = 0; r < next.size(); r++ ) {
+      if ( next[r] < run( r ).size()
+          and ( m == next.size()
+                or memcmp( run( r )[next[r]].key(), run( m )[next[m]].key(),
+                           Rec::KEY_LEN ) < 0 ) ) {
+        m = r;
+      }
+    }
+    locs.push_back( run( m )[next[m]++] );
+  }
+  return locs;
+}
+
+void Node::AddFile( string file )
+{
+  if ( global_ ) {
+    throw runtime_error( "Can't add files to a global index" );
+  }
+  File f( file, O_RDONLY );
+  if ( f.size() % Rec::SIZE != 0 ) {
+    throw runtime_error( "Not a whole number of records: " + file );
+  }
+
+  {
+    unique_lock<mutex> add( addMtx_ );
+    added_[file] = make_pair( ADD_PENDING, string() );
+    adds_.push_back( file );
+    if ( not indexer_.joinable() ) {
+      indexer_ = thread( &Node::indexer, this );
+    }
+  }
+  addCv_.notify_one();
+}
+
+Node::AddState Node::AddStatus( const string & file, string & error )
+{
+  unique_lock<mutex> add( addMtx_ );
+  auto s = added_.find( file );
+  if ( s == added_.end() ) {
+    return ADD_NONE;
+  }
+  error = s->second.second;
+  return s->second.first;
+}
+
+/* Index added files in turn, recording how each went, until closing */
+void Node::indexer( void )
+{
+  unique_lock<mutex> add( addMtx_ );
+  while ( true ) {
+    addCv_.wait( add, [this] { return closing_ or not adds_.empty(); } );
+    if ( adds_.empty() ) {
+      return;
+    }
+    string file = move( adds_.front() );
+    adds_.pop_front();
+
+    add.unlock();
+    auto status = make_pair( ADD_INDEXED, string() );
+    try {
+      index_file( file );
+    } catch ( const exception & e ) {
+      print_exception( e );
+      status = make_pair( ADD_FAILED, string( e.what() ) );
+    }
+    add.lock();
+    added_[file] = status;
+
+    // the file is served either way, so a failure here isn't the add's
+    if ( runs_.size() >= Knobs::INDEX_COMPACT_RUNS ) {
+      add.unlock();
+      try {
+        compact();
+      } catch ( const exception & e ) {
+        print_exception( e );
+      }
+      add.lock();
+    }
+  }
+}
+
+/* Index an added file into a new run */
+void Node::index_file( string file )
+{
+  auto start = time_now();
+
+  // only we add files, so know its disk number
+  File f( file, O_RDONLY );
+  uint32_t d = data_.size();
+  vector<RecordLoc> recs( f.size() / Rec::SIZE );
+  {
+    OverlappedRecordIO<Rec::SIZE> cio( f );
+    cio.rewind();
+    for ( uint64_t i = 0; i < recs.size(); i++ ) {
+      const uint8_t * rec = (const uint8_t *) cio.next_record();
+      recs[i].copy( rec, i * Rec::SIZE + Rec::KEY_LEN, 0, d );
+    }
+  }
+  rec_sort( recs.begin(), recs.end() );
+
+  {
+    unique_lock<mutex> lck( mtx_ );
+    data_.push_back( move( f ) );
+    files_.push_back( file );
+    runs_.push_back( move( recs ) );
+  }
+  cout << "index-add: " << file << ", " << time_diff<ms>( start ) << "mS, "
+       << runs_.size() << " runs" << endl;
+}
+
+/* Merge the runs into recs_, off to the side while we keep serving */
+void Node::compact( void )
+{
+  auto start = time_now();
+
+  // merge the (small) runs together, then with the main index, stably and
+  // older first, so ties stay in the order reads merging the runs gave them
+  size_t n = runs_.size();
+  vector<RecordLoc> added( runs_[0] );
+  for ( size_t r = 1; r < n; r++ ) {
+    vector<RecordLoc> out( added.size() + runs_[r].size() );
+    merge( added.begin(), added.end(), runs_[r].begin(), runs_[r].end(),
+           out.begin() );
+    added.swap( out );
+  }
+  vector<RecordLoc> all( recs_.size() + added.size() );
+  pmerge_copy( recs_.data(), recs_.data() + recs_.size(),
+               added.data(), added.data() + added.size(),
+               all.data(), all.data() + all.size() );
+  added = vector<RecordLoc>();
+
+  LearnedIndex learned;
+  if ( LearnedIndex::ENABLED ) {
+    learned.train( all );
+  }
+
+  {
+    unique_lock<mutex> lck( mtx_ );
+    recs_.swap( all );
+    learned_ = move( learned );
+    runs_.erase( runs_.begin(), runs_.begin() + n );
+  }
+  cout << "compact: " << time_diff<ms>( start ) << "mS, " << n << " runs, "
+       << recs_.size() << " entries" << endl;
+}
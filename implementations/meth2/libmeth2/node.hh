@@ -1,6 +1,14 @@
 #ifndef METH2_NODE_HH
 #define METH2_NODE_HH
 
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+
 #include "buffered_io.hh"
 #include "file.hh"
 #include "overlapped_rec_io.hh"
@@ -10,6 +18,10 @@
 
 #include "record.hh"
 
+#include "global_index.hh"
+#include "learned_index.hh"
+#include "value_cache.hh"
+
 /* Sorting strategy to use? Ordered slowest to fastest. */
 #define USE_PQ 0
 #define USE_CHUNK 1
@@ -44,6 +56,9 @@ public:
   using RR = Record;
   using RecV = std::vector<RR>;
 
+  /* How adding a file has gone */
+  enum AddState : uint8_t { ADD_NONE, ADD_PENDING, ADD_INDEXED, ADD_FAILED };
+
 private:
   std::vector<File> data_;
   std::vector<std::string> files_;
@@ -54,6 +69,31 @@ private:
   uint64_t fpos_;
   uint64_t lpass_;
 
+  /* set when this node holds a range of a global index */
+  std::unique_ptr<GlobalIndex> global_;
+
+  /* model of recs_ for key lookups */
+  LearnedIndex learned_;
+
+  /* recently read values, when enabled */
+  std::unique_ptr<ValueCache> cache_;
+
+  /* sorted runs indexing files added since Initialize, oldest first, which
+   * reads merge with recs_ (as run 0) until compacted into it */
+  std::vector<std::vector<RecordLoc>> runs_;
+
+  /* held while serving an RPC, and to change the index */
+  std::mutex mtx_;
+
+  /* files waiting for the indexer thread, which indexes them one at a time,
+   * and how each file added has gone (with why, if it failed) */
+  std::mutex addMtx_;
+  std::condition_variable addCv_;
+  std::deque<std::string> adds_;
+  std::map<std::string, std::pair<AddState, std::string>> added_;
+  bool closing_;
+  std::thread indexer_;
+
 public:
   Node( std::vector<std::string> file, std::string port);
 
@@ -63,20 +103,68 @@ public:
   Node( Node && n ) = delete;
   Node & operator=( Node && n ) = delete;
 
+  ~Node( void );
+
   /* Run the node - list and respond to RPCs */
   void Run( void );
 
+  /* Join a global index as node id of peers, before Initialize */
+  void Globalize( uint32_t id, std::vector<Address> peers );
+
   /* API */
   void Initialize( void );
   RecV Read( uint64_t pos, uint64_t size );
   uint64_t Size( void );
 
+  /* Records sorting below key (below), and at or below key (upto) */
+  void Rank( const uint8_t * key, uint64_t & below, uint64_t & upto );
+  /* Key of the i'th record */
+  const uint8_t * Select( uint64_t i );
+
+  /* Smallest (up to) limit records with keys in [lo, hi), after skipping the
+   * first skip of them. At most RANGE_MAX_RECORDS. */
+  RecV ReadRange( const uint8_t * lo, uint64_t skip, const uint8_t * hi,
+                  uint64_t limit );
+
+  /* Records at each of a batch of (scattered) positions, in the same order */
+  RecV Get( const std::vector<uint64_t> & pos );
+
+  /* Index a new data file in the background, serving it once indexed */
+  void AddFile( std::string file );
+  /* How adding file has gone, and why, if it failed */
+  AddState AddStatus( const std::string & file, std::string & error );
+
 private:
   RecV linear_scan( uint64_t pos , uint64_t size );
+  RecV global_read( uint64_t pos , uint64_t size );
+  RecV fetch( std::vector<RecordLoc> & locs );
+  uint64_t DataSize( void );
+
+  void indexer( void );
+  void index_file( std::string file );
+  void compact( void );
+
+  /* Reading across recs_ and runs_ */
+  const std::vector<RecordLoc> & run( size_t r ) const noexcept
+  {
+    return r == 0 ? recs_ : runs_[r - 1];
+  }
+  uint64_t IndexSize( void ) const noexcept;
+  void split( uint64_t pos, std::vector<uint64_t> & at );
+  const RecordLoc & at( uint64_t i );
+  std::vector<RecordLoc> merged( uint64_t pos, uint64_t size );
 
   void RPC_Read( BufferedIO_O<TCPSocket> & client );
   void RPC_IRead( BufferedIO_O<TCPSocket> & client );
   void RPC_Size( BufferedIO_O<TCPSocket> & client );
+  void RPC_Info( BufferedIO_O<TCPSocket> & client );
+  void RPC_Rank( BufferedIO_O<TCPSocket> & client );
+  void RPC_Select( BufferedIO_O<TCPSocket> & client );
+  void RPC_ReadRange( BufferedIO_O<TCPSocket> & client );
+  void RPC_Get( BufferedIO_O<TCPSocket> & client );
+  void RPC_AddFile( BufferedIO_O<TCPSocket> & client );
+  void RPC_AddStatus( BufferedIO_O<TCPSocket> & client );
+  void write_recs( BufferedIO_O<TCPSocket> & client, const RecV & recs );
 };
 }
 
@@ -0,0 +1,109 @@
+#include <cstring>
+#include <stdexcept>
+#include <string>
+
+#include "file.hh"
+
+#include "value_cache.hh"
+
+using namespace std;
+using namespace meth2;
+
+/* rough per-entry cost of a shard's hash map */
+static constexpr uint64_t MAP_ENTRY_BYTES = 32;
+
+ValueCache::ValueCache( uint64_t bytes )
+  : shards_{new Shard[SHARDS]}
+  , capacity_{bytes / ( sizeof( Slot ) + MAP_ENTRY_BYTES ) / SHARDS}
+  , hits_{0}
+  , misses_{0}
+{
+}
+
+/* files are well under 2^48 bytes, leaving the top bits for the disk */
+uint64_t ValueCache::key( uint32_t disk, uint64_t loc ) noexcept
+{
+  return ( uint64_t( disk ) << 48 ) ^ loc;
+}
+
+ValueCache::Shard & ValueCache::shard( uint64_t key ) noexcept
+{
+  // locations are multiples of the record size, so mix before picking
+  return shards_[( key * 0x9E3779B97F4A7C15 >> 32 ) % SHARDS];
+}
+
+bool ValueCache::get( uint32_t disk, uint64_t loc, uint8_t * val )
+{
+  uint64_t k = key( disk, loc );
+  Shard & s = shard( k );
+  {
+    unique_lock<mutex> lck( s.mtx );
+    auto it = s.slot.find( k );
+    if ( it != s.slot.end() ) {
+      Slot & e = s.slots[it->second];
+      e.ref = true;
+      memcpy( val, e.val, Rec::VAL_LEN );
+      hits_++;
+      return true;
+    }
+  }
+  misses_++;
+  return false;
+}
+
+void ValueCache::put( uint32_t disk, uint64_t loc, const uint8_t * val )
+{
+  if ( capacity_ == 0 ) {
+    return;
+  }
+
+  uint64_t k = key( disk, loc );
+  Shard & s = shard( k );
+  unique_lock<mutex> lck( s.mtx );
+  if ( s.slot.count( k ) != 0 ) {
+    return;
+  }
+
+  uint32_t i;
+  if ( s.slots.size() < capacity_ ) {
+    i = s.slots.size();
+    s.slots.emplace_back();
+  } else {
+    // sweep for an entry not referenced since we last passed it
+    while ( s.slots[s.hand].ref ) {
+      s.slots[s.hand].ref = false;
+      s.hand = ( s.hand + 1 ) % capacity_;
+    }
+    i = s.hand;
+    s.hand = ( s.hand + 1 ) % capacity_;
+    s.slot.erase( s.slots[i].key );
+  }
+
+  Slot & e = s.slots[i];
+  e.key = k;
+  e.ref = false;
+  memcpy( e.val, val, Rec::VAL_LEN );
+  s.slot.emplace( k, i );
+}
+
+void ValueCache::read( File & file, uint32_t disk, uint64_t loc,
+                       uint8_t * val )
+{
+  if ( not get( disk, loc, val ) ) {
+    // never cache (or serve) a truncated value
+    if ( file.pread_all( (char *) val, Rec::VAL_LEN, loc ) != Rec::VAL_LEN ) {
+      throw runtime_error( "Short read of value at " + to_string( loc ) );
+    }
+    put( disk, loc, val );
+  }
+}
+
+uint64_t ValueCache::size( void )
+{
+  uint64_t n = 0;
+  for ( uint64_t i = 0; i < SHARDS; i++ ) {
+    unique_lock<mutex> lck( shards_[i].mtx );
+    n += shards_[i].slots.size();
+  }
+  return n;
+}
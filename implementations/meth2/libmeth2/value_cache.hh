@@ -0,0 +1,96 @@
+#ifndef METH2_VALUE_CACHE_HH
+#define METH2_VALUE_CACHE_HH
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+
+#include "file.hh"
+
+#include "record.hh"
+
+#include "tune_knobs.hh"
+
+namespace meth2
+{
+
+/**
+ * ValueCache keeps recently read values in memory, keyed by where they live on
+ * disk (disk, loc), so repeated reads of the same records skip the disk.
+ *
+ * The cache is split into SHARDS shards by key, each with its own lock, so the
+ * parallel readers of Circular_AIO rarely contend. Each shard evicts by CLOCK:
+ * a hit sets an entry's reference bit, and the hand clears bits as it sweeps,
+ * evicting the first entry it finds without one. Shards fill lazily, up to
+ * their share of the BYTES budget.
+ */
+class ValueCache
+{
+public:
+  static constexpr bool ENABLED = Knobs::VALUE_CACHE;
+  static constexpr uint64_t BYTES = Knobs::VALUE_CACHE_BYTES;
+  static constexpr uint64_t SHARDS = Knobs::VALUE_CACHE_SHARDS;
+
+private:
+  struct Slot
+  {
+    uint64_t key;
+    bool ref;
+    uint8_t val[Rec::VAL_LEN];
+  };
+
+  struct Shard
+  {
+    std::mutex mtx;
+    std::unordered_map<uint64_t, uint32_t> slot;
+    std::vector<Slot> slots;
+    size_t hand;
+
+    Shard( void )
+      : mtx{}
+      , slot{}
+      , slots{}
+      , hand{0}
+    {
+    }
+
+    /* no copy */
+    Shard( const Shard & ) = delete;
+    Shard & operator=( const Shard & ) = delete;
+  };
+
+  std::unique_ptr<Shard[]> shards_;
+  size_t capacity_; // slots per shard
+
+  std::atomic<uint64_t> hits_;
+  std::atomic<uint64_t> misses_;
+
+  static uint64_t key( uint32_t disk, uint64_t loc ) noexcept;
+  Shard & shard( uint64_t key ) noexcept;
+
+public:
+  ValueCache( uint64_t bytes = BYTES );
+
+  /* no copy */
+  ValueCache( const ValueCache & ) = delete;
+  ValueCache & operator=( const ValueCache & ) = delete;
+
+  /* Copy the value at (disk, loc) to val if cached */
+  bool get( uint32_t disk, uint64_t loc, uint8_t * val );
+
+  /* Remember the value at (disk, loc), evicting another if full */
+  void put( uint32_t disk, uint64_t loc, const uint8_t * val );
+
+  /* Read the value at (disk, loc) from the cache, or else from the file
+   * (throwing if it's cut short) */
+  void read( File & file, uint32_t disk, uint64_t loc, uint8_t * val );
+
+  uint64_t hits( void ) const noexcept { return hits_; }
+  uint64_t misses( void ) const noexcept { return misses_; }
+  uint64_t size( void );
+};
+}
+
+#endif /* METH2_VALUE_CACHE_HH */
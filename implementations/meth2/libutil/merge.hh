@@ -178,8 +178,9 @@ __pmerge_copy( T * s1, T * e1, T * s2, T * e2, T * rs, T * re, T * & s1f )
   } else {
     size_t mid = len2 < lenR ? len2 / 2 : lenR / 2;
 
+    // s1's ties with the pivot go left, ahead of s2's, to keep it stable
     T *m2 = &s2[mid];
-    T *m1 = std::lower_bound( s1, e1, *m2 );
+    T *m1 = std::upper_bound( s1, e1, *m2 );
 
     T *ss1 = s1, *ee1 = m1;
     T *ss2 = s2, *ee2 = s2 + mid;
@@ -199,7 +200,8 @@ __pmerge_copy( T * s1, T * e1, T * s2, T * e2, T * rs, T * re, T * & s1f )
 
 /* A parallel merge using copy. Returns the iterator at which we finished
  * merging from each buffer. This may be less than their ends as the output
- * buffer may have become full first. */
+ * buffer may have become full first. Stable: of equal elements, those from
+ * s1 come first. */
 template <typename T>
 std::pair<T*,T*>
 pmerge_copy( T * s1, T * e1, T * s2, T * e2, T * rs, T * re )
@@ -243,8 +245,9 @@ pmerge_move( T * s1, T * e1, T * s2, T * e2, T * rs, T * re )
   } else {
     size_t mid = len2 < lenR ? len2 / 2 : lenR / 2;
 
+    // s1's ties with the pivot go left, ahead of s2's, to keep it stable
     T *m2 = &s2[mid];
-    T *m1 = std::lower_bound( s1, e1, *m2 );
+    T *m1 = std::upper_bound( s1, e1, *m2 );
 
     T *ss1 = s1, *ee1 = m1;
     T *ss2 = s2, *ee2 = s2 + mid;
@@ -262,4 +265,63 @@ pmerge_move( T * s1, T * e1, T * s2, T * e2, T * rs, T * re )
   }
 }
 
+/* Merge the adjacent sorted ranges [s, m) and [m, e) in place, with just the
+ * n elements at buf as scratch. Ranges that fit in it merge through it, others
+ * are split around a pivot and rotated into place first (as
+ * std::inplace_merge does when short of memory), merging the two halves in
+ * parallel, with half of buf each. Stable: of equal elements, those from
+ * [s, m) come first. */
+template <typename T>
+void
+pmerge_inplace( T * s, T * m, T * e, T * buf, size_t n )
+{
+  size_t len1 = m - s, len2 = e - m;
+  if ( len1 == 0 or len2 == 0 ) {
+    return;
+  } else if ( len1 + len2 == 2 ) {
+    if ( *m < *s ) {
+      std::swap( *s, *m );
+    }
+    return;
+  } else if ( len1 <= n and ( len1 <= len2 or len2 > n ) ) {
+    // forwards, from a copy of the first
+    T * b = buf, * be = std::move( s, m, buf );
+    while ( b != be and m != e ) {
+      *s++ = std::move( ( *m < *b ) ? *m++ : *b++ );
+    }
+    std::move( b, be, s );
+    return;
+  } else if ( len2 <= n ) {
+    // backwards, from a copy of the second
+    T * be = std::move( m, e, buf );
+    while ( be != buf and m != s ) {
+      *--e = std::move( ( *( be - 1 ) < *( m - 1 ) ) ? *--m : *--be );
+    }
+    std::move_backward( buf, be, e );
+    return;
+  }
+
+  T * c1, * c2;
+  if ( len1 > len2 ) {
+    c1 = s + len1 / 2;
+    c2 = std::lower_bound( m, e, *c1 );
+  } else {
+    c2 = m + len2 / 2;
+    c1 = std::upper_bound( s, m, *c2 );
+  }
+  T * nm = std::rotate( c1, m, c2 );
+
+#ifdef HAVE_TBB_PARALLEL_INVOKE_H
+  if ( len1 + len2 >= SPLIT_MIN and n > 1 ) {
+    tbb::parallel_invoke(
+      [&] { pmerge_inplace( s, c1, nm, buf, n / 2 ); },
+      [&] { pmerge_inplace( nm, c2, e, buf + n / 2, n - n / 2 ); }
+    );
+    return;
+  }
+#endif
+  pmerge_inplace( s, c1, nm, buf, n );
+  pmerge_inplace( nm, c2, e, buf, n );
+}
+
 #endif /* MERGE_HH */
@@ -51,6 +51,57 @@ namespace Knobs {
   /* Use parallel sort? */
   static constexpr bool PARALLEL_SORT = true;
 
+  /* Index build: records each disk loads before handing them off to be
+   * sorted while it loads more. */
+  static constexpr uint64_t INDEX_SORT_CHUNK = 1024 * 1024 * 4;
+
+  /* Index build: scratch (in records) the sorted chunks are merged in place
+   * with, shared between the merges running at once. */
+  static constexpr uint64_t INDEX_MERGE_BUFFER = 1024 * 1024 * 4;
+
+  /* Most records a node returns for one key-range read. */
+  static constexpr uint64_t RANGE_MAX_RECORDS = 1024 * 1024; // 100MB
+
+  /* Files added to a running node are indexed into sorted runs, which reads
+   * merge with the main index. Compact runs into it once this many pile up. */
+  static constexpr uint64_t INDEX_COMPACT_RUNS = 4;
+
+  /* Adding a file: how often the coordinator asks if the node's done. */
+  static constexpr uint64_t ADD_POLL_MS = 10;
+
+  /* Global index: keys each node samples from its local index to pick the
+   * key ranges that nodes own. */
+  static constexpr uint64_t GLOBAL_INDEX_SAMPLES = 4096;
+
+  /* Connecting to peers: backoff between attempts (doubling from the first up
+   * to the max), and when to give up (seconds). */
+  static constexpr std::size_t CONNECT_BACKOFF_MS = 10;
+  static constexpr std::size_t CONNECT_BACKOFF_MAX_MS = 1000;
+  static constexpr std::size_t CONNECT_TIMEOUT = 120;
+
+  /* Learned index over the sorted index: a linear model per segment of about
+   * this many records, found through a table on this many leading key bits. */
+  static constexpr bool LEARNED_INDEX = true;
+  static constexpr uint64_t LEARNED_INDEX_SEGMENT = 1024;
+  static constexpr uint64_t LEARNED_INDEX_RADIX_BITS = 18;
+
+  /* Batched gets: the coordinator resolves positions against the split of the
+   * nodes at every this many positions, caching up to this many of the splits
+   * it finds. */
+  static constexpr uint64_t GET_SPLITTER_STRIDE = 1024;
+  static constexpr uint64_t GET_SPLITTER_CACHE = 1024 * 64;
+
+  /* Batched gets: requests the coordinator has in flight to a node at once.
+   * Few enough that they fit in the socket buffers, so it never blocks
+   * sending to a node that is blocked sending replies back to it. */
+  static constexpr uint64_t GET_PIPELINE = 1024;
+
+  /* Cache of recently read values on each node: memory budget (on top of the
+   * index), and how many independently locked shards to split it into. */
+  static constexpr bool VALUE_CACHE = true;
+  static constexpr uint64_t VALUE_CACHE_BYTES = 1024 * 1024 * uint64_t( 256 );
+  static constexpr uint64_t VALUE_CACHE_SHARDS = 64;
+
   /* Use hand-rolled memcmp? */
   static constexpr bool USE_OWN_MEMCMP = false;
 